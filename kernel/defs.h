@@ -2,6 +2,8 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct logstat;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -33,10 +35,24 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filecopy(struct file*, struct file*, int n);
+int             filesplice(struct file*, struct file*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepread(struct file*, uint64, int n, uint off);
+int             filepwrite(struct file*, uint64, int n, uint off);
+int             fileseek(struct file*, int, int);
+int             filepoll(struct file*, int);
+void            pollwakeup(void);
+uint            pollstart(void);
+uint            pollsleep(uint);
+void            pollend(void);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+void            dcinit(void);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
@@ -52,6 +68,8 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             writeblocks(uint, uint);
+int             copyi(struct inode*, uint, struct inode*, uint, uint);
 void            itrunc(struct inode*);
 
 // ramdisk.c
@@ -61,20 +79,30 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
 void            kfree(void *);
 void            kinit(void);
+int             kzero_pages(int);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_freed(uint);
+void            log_stat(struct logstat*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int);
+int             pipereadv(struct pipe*, int, struct iovec*, int);
+int             pipewrite(struct pipe*, int, uint64, int);
+int             pipepoll(struct pipe*, int);
+int             pipesplicein(struct pipe*, struct file*, int);
+int             pipespliceout(struct pipe*, struct file*, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -86,6 +114,8 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
+int             clone(uint64, uint64, uint64);
+int             join(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -100,6 +130,9 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             wakeupn(void*, int);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -139,6 +172,9 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+void            fdrelease(void);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -149,7 +185,7 @@ void            usertrapret(void);
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+int             uartwrite(int, uint64, int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -166,6 +202,7 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t*          walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -3,7 +3,9 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "mm.h"
 #include "defs.h"
 #include "elf.h"
 
@@ -21,11 +23,21 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // the other threads would lose their memory. clone() must
+  // not add one until the new image is in place.
+  acquire(&p->mm->lock);
+  if(p->mm->ref > 1){
+    release(&p->mm->lock);
+    return -1;
+  }
+  p->mm->execing = 1;
+  release(&p->mm->lock);
+
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
-    return -1;
+    goto bad;
   }
   ilock(ip);
 
@@ -62,7 +74,7 @@ exec(char *path, char **argv)
   ip = 0;
 
   p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz = p->mm->sz;
 
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
@@ -110,11 +122,20 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
-  p->pagetable = pagetable;
-  p->sz = sz;
+  p->pagetable = p->mm->pagetable = pagetable;
+  p->mm->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  // a thread whose siblings are gone may have its trapframe
+  // in another slot; the new page table has it in slot 0.
+  uvmunmap(oldpagetable, TRAMPOLINE, 1, 0);
+  uvmunmap(oldpagetable, TRAPFRAMEAT(p->tfslot), 1, 0);
+  uvmfree(oldpagetable, oldsz);
+  acquire(&p->mm->lock);
+  p->mm->tfslots = 1;
+  p->mm->execing = 0;
+  release(&p->mm->lock);
+  p->tfslot = 0;
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -125,6 +146,9 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  acquire(&p->mm->lock);
+  p->mm->execing = 0;
+  release(&p->mm->lock);
   return -1;
 }
 
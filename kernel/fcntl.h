@@ -3,6 +3,14 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800  // reads and writes fail rather than wait
+
+#define F_GETFL   3  // fcntl() commands
+#define F_SETFL   4
+
+#define SEEK_SET  0  // lseek() whence values
+#define SEEK_CUR  1
+#define SEEK_END  2
 
 #ifdef LAB_MMAP
 #define PROT_NONE       0x0
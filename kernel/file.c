@@ -12,6 +12,9 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
+#include "iovec.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -19,10 +22,21 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+// A process in poll() sleeps on polls.seq. Anything that may
+// make a file ready calls pollwakeup(), which bumps seq, so a
+// poller that checked its files just before the change sees
+// that seq moved and looks again instead of sleeping.
+struct {
+  struct spinlock lock;
+  uint seq;
+  int n;      // number of processes in poll()
+} polls;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&polls.lock, "poll");
 }
 
 // Allocate a file structure.
@@ -35,6 +49,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->nonblock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -112,10 +127,12 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, f->nonblock, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
+    if(f->nonblock && (filepoll(f, POLLIN) & POLLIN) == 0)
+      return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
@@ -129,54 +146,359 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Write n bytes from user address addr to ip at *off,
+// advancing *off as the data goes out.
+// Returns n, or -1 if not everything was written.
+static int
+inodewrite(struct inode *ip, uint64 addr, uint *off, int n)
+{
+  int r, i;
+
+  // write WRITEBLOCKS blocks at a time to avoid exceeding
+  // the maximum log transaction size.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = WRITEBLOCKS * BSIZE;
+  i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_opn(writeblocks(*off, n1));
+    ilock(ip);
+    if ((r = writei(ip, 1, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(ip);
+    end_op();
+
+    if(r != n1){
+      // error from writei
+      break;
+    }
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, f->nonblock, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
+    if(f->nonblock && (filepoll(f, POLLOUT) & POLLOUT) == 0)
+      return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+    ret = inodewrite(f->ip, addr, &f->off, n);
+  } else {
+    panic("filewrite");
+  }
+
+  return ret;
+}
+
+// Read from file f at offset off, leaving f->off alone.
+// Only inodes have offsets; pipes and devices fail.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  r = readi(f->ip, 1, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Write to file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f->ip, addr, &off, n);
+}
+
+// Set the offset of file f relative to the start, the
+// current offset or the end, as whence says.
+// Returns the new offset.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int base;
+
+  if(f->type != FD_INODE)
+    return -1;
+  switch(whence){
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = f->off;
+    break;
+  case SEEK_END:
+    ilock(f->ip);
+    base = f->ip->size;
+    iunlock(f->ip);
+    break;
+  default:
+    return -1;
+  }
+  if(base + off < 0)
+    return -1;
+  f->off = base + off;
+  return f->off;
+}
+
+
+// Move up to n bytes from fin to fout inside the kernel,
+// without a round trip through a user buffer.
+// One file must be a pipe and the other an inode.
+int
+filesplice(struct file *fin, struct file *fout, int n)
+{
+  if(fin->readable == 0 || fout->writable == 0 || n < 0)
+    return -1;
+
+  if(fin->type == FD_INODE && fout->type == FD_PIPE)
+    return pipesplicein(fout->pipe, fin, n);
+  if(fin->type == FD_PIPE && fout->type == FD_INODE)
+    return pipespliceout(fin->pipe, fout, n);
+  return -1;
+}
+
+// Copy up to n bytes from inode file fin to inode file fout
+// inside the kernel, advancing both offsets. Each transaction
+// writes as many data blocks as the log allows for one
+// operation, rather than filewrite()'s conservative share.
+// Returns the number of bytes copied, 0 at end of fin, or -1.
+int
+filecopy(struct file *fin, struct file *fout, int n)
+{
+  struct inode *a, *b;
+  int r, tot, m;
+  int max = WRITEBLOCKS * BSIZE;
+
+  if(fin->readable == 0 || fout->writable == 0 || n < 0)
+    return -1;
+  if(fin->type != FD_INODE || fout->type != FD_INODE || fin->ip == fout->ip)
+    return -1;
+
+  // lock the two inodes in a fixed order to avoid deadlock
+  // with a copy going the other way.
+  a = fin->ip;
+  b = fout->ip;
+  if(a->inum > b->inum){
+    a = fout->ip;
+    b = fin->ip;
+  }
+
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot;
+    if(m > max - fout->off % BSIZE)
+      m = max - fout->off % BSIZE;
+
+    begin_opn(writeblocks(fout->off, m));
+    ilock(a);
+    ilock(b);
+    if((r = copyi(fin->ip, fin->off, fout->ip, fout->off, m)) > 0){
+      fin->off += r;
+      fout->off += r;
+    }
+    iunlock(b);
+    iunlock(a);
+    end_op();
+
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    if(r < m)
+      return tot + r;
+  }
+  return tot;
+}
+
+// Read from file f into the niov user buffers described by iov,
+// filling each before moving on to the next.
+// An inode is locked once for the whole request.
+int
+filereadv(struct file *f, struct iovec *iov, int niov)
+{
+  int i, r = 0, tot;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE)
+    return pipereadv(f->pipe, f->nonblock, iov, niov);
+
+  tot = 0;
+  if(f->type == FD_INODE){
+    ilock(f->ip);
+    for(i = 0; i < niov; i++){
+      r = readi(f->ip, 1, (uint64)iov[i].iov_base, f->off, iov[i].iov_len);
+      if(r > 0){
         f->off += r;
+        tot += r;
+      }
+      if(r != iov[i].iov_len)
+        break;
+    }
+    iunlock(f->ip);
+  } else {
+    // like successive read()s, stopping at the first short one.
+    for(i = 0; i < niov; i++){
+      r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len);
+      if(r > 0)
+        tot += r;
+      if(r != iov[i].iov_len)
+        break;
+    }
+  }
+  if(tot == 0 && r < 0)
+    return -1;
+  return tot;
+}
+
+// Write the niov user buffers described by iov to file f.
+// For an inode, each transaction takes as much of the
+// request as filewrite() would write in one.
+int
+filewritev(struct file *f, struct iovec *iov, int niov)
+{
+  int i, r, m, room, tot, want;
+  uint64 off;
+  int max = WRITEBLOCKS * BSIZE;
+
+  if(f->writable == 0)
+    return -1;
+
+  want = 0;
+  for(i = 0; i < niov; i++)
+    want += iov[i].iov_len;
+
+  tot = 0;
+  if(f->type == FD_INODE){
+    i = 0;
+    off = 0;  // bytes of iov[i] already written
+    r = 0;
+    while(i < niov && r >= 0){
+      m = want - tot;
+      if(m > max)
+        m = max;
+      begin_opn(writeblocks(f->off, m));
+      ilock(f->ip);
+      for(room = max; room > 0 && i < niov; ){
+        m = iov[i].iov_len - off;
+        if(m > room)
+          m = room;
+        if((r = writei(f->ip, 1, (uint64)iov[i].iov_base + off, f->off, m)) > 0){
+          f->off += r;
+          tot += r;
+          room -= r;
+          off += r;
+        }
+        if(r != m){
+          r = -1;
+          break;
+        }
+        if(off == iov[i].iov_len){
+          i++;
+          off = 0;
+        }
+      }
       iunlock(f->ip);
       end_op();
-
-      if(r != n1){
-        // error from writei
+    }
+  } else {
+    for(i = 0; i < niov; i++){
+      if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
         break;
-      }
-      i += r;
+      tot += r;
     }
-    ret = (i == n ? n : -1);
+  }
+  return tot == want ? tot : -1;
+}
+
+// Report which of events, plus POLLHUP, hold for file f.
+// Inodes are always ready.
+int
+filepoll(struct file *f, int events)
+{
+  int r;
+
+  if(f->type == FD_PIPE){
+    r = pipepoll(f->pipe, f->writable);
+  } else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+            devsw[f->major].poll){
+    r = devsw[f->major].poll();
   } else {
-    panic("filewrite");
+    r = POLLIN | POLLOUT;
   }
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r & (events | POLLHUP);
+}
 
-  return ret;
+// Called by anything that may have made a file ready.
+void
+pollwakeup(void)
+{
+  // a poller registers in polls.n before it checks its files,
+  // so if it missed this change it is already counted here.
+  if(__atomic_load_n(&polls.n, __ATOMIC_SEQ_CST) == 0)
+    return;
+  acquire(&polls.lock);
+  polls.seq++;
+  wakeup(&polls.seq);
+  release(&polls.lock);
 }
 
+// Register the caller as a poller.
+// Returns the sequence number to pass to pollsleep().
+uint
+pollstart(void)
+{
+  uint seq;
+
+  acquire(&polls.lock);
+  polls.n++;
+  seq = polls.seq;
+  release(&polls.lock);
+  return seq;
+}
+
+// Sleep until something may have become ready since the
+// sequence number seq was taken. Returns the new one.
+uint
+pollsleep(uint seq)
+{
+  acquire(&polls.lock);
+  if(polls.seq == seq)
+    sleep(&polls.seq, &polls.lock);
+  seq = polls.seq;
+  release(&polls.lock);
+  return seq;
+}
+
+void
+pollend(void)
+{
+  acquire(&polls.lock);
+  polls.n--;
+  release(&polls.lock);
+}
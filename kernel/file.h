@@ -3,12 +3,23 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
 };
 
+// File writes go to the log in transactions of at most
+// WRITEBLOCKS blocks of data, each reserving what writeblocks()
+// says it may dirty. WRITEOPBLOCKS is the most that can be:
+// the data (when log_data() must log it) spanning one block
+// more than WRITEBLOCKS if unaligned, the index blocks on the
+// paths to both ends, a bitmap block for each of those, and
+// the inode.
+#define WRITEBLOCKS   32
+#define WRITEOPBLOCKS (2*(WRITEBLOCKS + 1 + 2*NLEVELS) + 1)
+
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
@@ -18,6 +29,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // hash chain
+  struct inode *prev; // LRU list of unreferenced inodes
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,13 +40,20 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+NLEVELS];
+
+  uint goal;          // where to look for the next free block
+  uint rsv;           // reservation window, see balloc()
+  uint rsvend;
+  struct inode *rsvnext;
+  uint dfree;         // directories: no free dirent below this offset
 };
 
 // map major device number to device functions.
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*poll)(void);  // POLLIN/POLLOUT readiness; 0 means always ready
 };
 
 extern struct devsw devsw[];
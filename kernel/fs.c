@@ -37,6 +37,9 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+static void hintinit(int);
+static void ireclaim(int);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,6 +47,8 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  hintinit(dev);
+  ireclaim(dev);
 }
 
 // Zero a block.
@@ -60,31 +65,225 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Each in-memory inode may hold a reservation window of
+// up to RSVBLOCKS free blocks just after the one it last got,
+// [ip->rsv, ip->rsvend), so that a file written a block at a
+// time ends up contiguous on disk even when other files are
+// growing at the same time. Windows live only in memory:
+// balloc() leaves other inodes' windows alone unless there
+// is no other free block, and a window is dropped when the
+// last reference to its inode goes away. Windows only steer
+// where a block goes, never whether one is found.
+// Inodes with a window are on rsvlist, linked by rsvnext.
+// rsvlock protects every inode's rsv, rsvend and rsvnext.
+#define RSVBLOCKS 16
+struct spinlock rsvlock;
+struct inode *rsvlist;
+
+// Is block b in a window held by an inode other than ip?
+// Caller must hold rsvlock.
+static int
+reserved(struct inode *ip, uint b)
+{
+  struct inode *q;
+
+  for(q = rsvlist; q; q = q->rsvnext){
+    if(q != ip && q->rsv <= b && b < q->rsvend)
+      return 1;
+  }
+  return 0;
+}
+
+// Free-space summaries of the bitmap blocks and the inode
+// blocks, so that allocation neither reads blocks that have
+// nothing free nor rescans the full part of a block. Built by
+// hintinit() and afterwards changed only by whoever holds the
+// lock on the buffer of the block described. The allocators
+// peek at nfree without that lock; a stale value only sends
+// them to look at another block first.
+#define NBHINT  64    // bitmap blocks: up to 512K disk blocks
+#define NIHINT 256    // inode blocks: up to 4096 inodes
+struct blkhint {
+  ushort nfree;       // free blocks or inodes in the block
+  ushort next;        // none free below this index
+};
+struct {
+  uint nbmap;         // bitmap blocks in use
+  uint ninode;        // inode blocks in use
+  struct blkhint bmap[NBHINT];
+  struct blkhint inode[NIHINT];
+} hint;
+
+// Is bit bi of bitmap block data set?
+#define BITSET(data, bi) ((data)[(bi)/8] & (1 << ((bi) % 8)))
+
+// Read every bitmap and inode block once to fill in hint.
+static void
+hintinit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  struct blkhint *h;
+  uint bn, bi, end, inum;
+
+  hint.nbmap = (sb.size + BPB - 1) / BPB;
+  hint.ninode = (sb.ninodes + IPB - 1) / IPB;
+  if(hint.nbmap > NBHINT || hint.ninode > NIHINT)
+    panic("hintinit: file system too big");
+
+  for(bn = 0; bn < hint.nbmap; bn++){
+    h = &hint.bmap[bn];
+    end = min(BPB, sb.size - bn * BPB);
+    h->next = end;
+    bp = bread(dev, sb.bmapstart + bn);
+    for(bi = 0; bi < end; bi++){
+      if(BITSET(bp->data, bi) == 0){
+        if(h->nfree++ == 0)
+          h->next = bi;
+      }
+    }
+    brelse(bp);
+  }
+
+  for(bn = 0; bn < hint.ninode; bn++){
+    h = &hint.inode[bn];
+    h->next = IPB;
+    bp = bread(dev, sb.inodestart + bn);
+    for(bi = 0; bi < IPB; bi++){
+      inum = bn * IPB + bi;
+      dip = (struct dinode*)bp->data + bi;
+      if(inum == 0 || inum >= sb.ninodes || dip->type != 0)
+        continue;
+      if(h->nfree++ == 0)
+        h->next = bi;
+    }
+    brelse(bp);
+  }
+}
+
+// Claim the first free block at or after bit start of bp, the
+// bn'th bitmap block, that is not in another inode's window,
+// or the first free block at all if steal is set.
+// Scans a 64-bit word at a time, skipping words with nothing
+// free. Updates ip's window and the hints.
+// Returns the block number, or 0 if there is none.
+// Caller must hold rsvlock and bp->lock.
 static uint
-balloc(uint dev)
+bclaim(struct inode *ip, struct buf *bp, uint bn, uint start, int steal)
 {
-  int b, bi, m;
+  struct blkhint *h = &hint.bmap[bn];
+  uint64 *w = (uint64*)bp->data;
+  uint64 x;
+  uint base, end, bi, e, i;
+  int skipped;
+
+  base = bn * BPB;
+  end = min(BPB, sb.size - base);
+  if(start < h->next)
+    start = h->next;
+  // a free block passed over because it is reserved keeps
+  // the hint from moving past it.
+  skipped = start != h->next;
+  for(i = start / 64; i * 64 < end; i++){
+    if(w[i] == ~0UL)
+      continue;
+    x = ~w[i];
+    if(i == start / 64)
+      x &= ~0UL << (start % 64);
+    for(bi = i * 64; x != 0 && bi < end; bi++, x >>= 1){
+      if((x & 1) == 0)
+        continue;
+      if(!steal && reserved(ip, base + bi)){
+        skipped = 1;
+        continue;
+      }
+      w[i] |= 1UL << (bi % 64);  // Mark block in use.
+      h->nfree--;
+      if(!skipped)
+        h->next = bi + 1;
+      if(base + bi < ip->rsv || base + bi >= ip->rsvend){
+        // open a new window over the free run after bi.
+        if(ip->rsvend == 0){
+          ip->rsvnext = rsvlist;
+          rsvlist = ip;
+        }
+        for(e = bi + 1; e < end && e < bi + 1 + RSVBLOCKS; e++){
+          if(BITSET(bp->data, e) || reserved(ip, base + e))
+            break;
+        }
+        ip->rsvend = base + e;
+      }
+      ip->rsv = base + bi + 1;
+      return base + bi;
+    }
+  }
+  return 0;
+}
+
+// Allocate a disk block for ip: the next block of its window
+// if there is one, otherwise the first free block at or after
+// ip->goal, which then starts a new window. Blocks in other
+// inodes' windows are taken only if nothing else is free.
+// If zero is set,
+// zero the block through the log; file data need not be, since
+// nothing past ip->size is ever read.
+// Caller must hold ip->lock.
+static uint
+balloc(struct inode *ip, int zero)
+{
+  uint goal, b, bn, i;
+  int steal;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+  acquire(&rsvlock);
+  goal = ip->rsv < ip->rsvend ? ip->rsv : ip->goal;
+  release(&rsvlock);
+  if(goal >= sb.size)
+    goal = 0;
+
+  // the goal's bitmap block from the goal on, then each
+  // bitmap block in turn, wrapping around to the goal's.
+  // if every free block is in someone's window, go round
+  // again taking blocks from the windows.
+  for(steal = 0; steal < 2; steal++){
+    bn = goal / BPB;
+    for(i = 0; i <= hint.nbmap; i++, bn = (bn + 1) % hint.nbmap){
+      if(hint.bmap[bn].nfree == 0)
+        continue;
+      bp = bread(ip->dev, sb.bmapstart + bn);
+      acquire(&rsvlock);
+      b = bclaim(ip, bp, bn, i == 0 ? goal % BPB : 0, steal);
+      release(&rsvlock);
+      if(b != 0){
+        ip->goal = b + 1;
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        if(zero)
+          bzero(ip->dev, b);
+        return b;
       }
+      brelse(bp);
     }
-    brelse(bp);
   }
   panic("balloc: out of blocks");
 }
 
+// Give up ip's reservation window.
+static void
+bunreserve(struct inode *ip)
+{
+  struct inode **pp;
+
+  acquire(&rsvlock);
+  if(ip->rsvend != 0){
+    for(pp = &rsvlist; *pp != ip; pp = &(*pp)->rsvnext)
+      ;
+    *pp = ip->rsvnext;
+  }
+  ip->rsv = ip->rsvend = 0;
+  release(&rsvlock);
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -98,6 +297,10 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  log_freed(b);
+  hint.bmap[b / BPB].nfree++;
+  if(bi < hint.bmap[b / BPB].next)
+    hint.bmap[b / BPB].next = bi;
   log_write(bp);
   brelse(bp);
 }
@@ -127,18 +330,20 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a table entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in table: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and
+//   current directories). An entry whose ref is zero is
+//   unreferenced but still holds its inode, and sits on
+//   the LRU list until iget() finds it again or recycles
+//   it for another inode. iget() finds or creates a table
+//   entry and increments its ref; iput() decrements ref.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid. It stays set while the entry is on the LRU
+//   list; iput() clears it only when it frees the inode on
+//   disk, and iget() when it recycles the entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -162,32 +367,87 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
+// The in-memory inodes are found through a hash table on
+// (dev, inum). Keeping unreferenced entries valid on the
+// LRU list means that using the file again soon after needs
+// no disk read in ilock(). iget() recycles the least
+// recently used of those entries, and adds a page's worth
+// of new entries when there are none.
+//
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// holds, one must hold itable.lock while using any of those
+// fields, or the hash chains and the LRU list.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
+  struct inode *hash[NIHASH];
+
+  // Unreferenced entries, linked through prev/next.
+  // head.next is the least recently used.
+  struct inode head;
   struct inode inode[NINODE];
 } itable;
 
+// Put ip at the most recently used end of the LRU list.
+static void
+lruput(struct inode *ip)
+{
+  ip->next = &itable.head;
+  ip->prev = itable.head.prev;
+  itable.head.prev->next = ip;
+  itable.head.prev = ip;
+}
+
+static void
+lrudel(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Add a page of new, unused entries.
+// Caller must hold itable.lock.
+static int
+igrow(void)
+{
+  struct inode *a, *ip;
+
+  if((a = (struct inode*)kalloc()) == 0)
+    return -1;
+  memset(a, 0, PGSIZE);
+  for(ip = a; ip < a + PGSIZE / sizeof(*ip); ip++){
+    initsleeplock(&ip->lock, "inode");
+    lruput(ip);
+  }
+  return 0;
+}
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
+  initlock(&rsvlock, "rsv");
+  itable.head.prev = &itable.head;
+  itable.head.next = &itable.head;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    lruput(&itable.inode[i]);
   }
 }
 
 static struct inode* iget(uint dev, uint inum);
+static void dcpurge(uint dev, uint dir);
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -195,19 +455,32 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  uint bn, i, inum;
+  struct blkhint *h;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+  for(bn = 0; bn < hint.ninode; bn++){
+    h = &hint.inode[bn];
+    if(h->nfree == 0)
+      continue;
+    bp = bread(dev, sb.inodestart + bn);
+    for(i = h->next; i < IPB; i++){
+      inum = bn * IPB + i;
+      if(inum == 0)
+        continue;
+      if(inum >= sb.ninodes)
+        break;
+      dip = (struct dinode*)bp->data + i;
+      if(dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        h->nfree--;
+        h->next = i + 1;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        return iget(dev, inum);
+      }
     }
     brelse(bp);
   }
@@ -226,6 +499,12 @@ iupdate(struct inode *ip)
 
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
+  if(dip->type != 0 && ip->type == 0){
+    // the inode is being freed.
+    hint.inode[ip->inum / IPB].nfree++;
+    if(ip->inum % IPB < hint.inode[ip->inum / IPB].next)
+      hint.inode[ip->inum / IPB].next = ip->inum % IPB;
+  }
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
@@ -242,31 +521,37 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = itable.hash[IHASH(dev, inum)]; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lrudel(ip);
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Recycle the least recently used inode entry.
+  if(itable.head.next == &itable.head && igrow() < 0)
     panic("iget: no inodes");
+  ip = itable.head.next;
+  lrudel(ip);
+  if(ip->inum != 0){
+    for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = itable.hash[IHASH(dev, inum)];
+  itable.hash[IHASH(dev, inum)] = ip;
   release(&itable.lock);
 
   return ip;
@@ -306,6 +591,8 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->goal = 0;
+    ip->dfree = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -344,6 +631,8 @@ iput(struct inode *ip)
     release(&itable.lock);
 
     itrunc(ip);
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
@@ -353,10 +642,42 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
+  if(ip->ref == 1){
+    bunreserve(ip);
+    lruput(ip);
+  }
   ip->ref--;
   release(&itable.lock);
 }
 
+// Free the inodes that have no links but are still allocated
+// on disk: files that were open when they were unlinked, or
+// whose truncation a crash cut short. Called at boot.
+static void
+ireclaim(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  struct inode *ip;
+  uint inum;
+  int orphan;
+
+  for(inum = 1; inum < sb.ninodes; inum++){
+    bp = bread(dev, IBLOCK(inum, sb));
+    dip = (struct dinode*)bp->data + inum%IPB;
+    orphan = dip->type != 0 && dip->nlink == 0;
+    brelse(bp);
+    if(!orphan)
+      continue;
+    begin_op();
+    ip = iget(dev, inum);
+    ilock(ip);
+    iunlock(ip);
+    iput(ip);
+    end_op();
+  }
+}
+
 // Common idiom: unlock, then put.
 void
 iunlockput(struct inode *ip)
@@ -370,70 +691,179 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT], the NDINDIRECT after
+// that in the blocks listed in block ip->addrs[NDIRECT+1],
+// and the last NTINDIRECT one level further down again,
+// under ip->addrs[NDIRECT+2].
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, allocate one if alloc is set,
+// otherwise return 0.
 static uint
-bmap(struct inode *ip, uint bn)
+bwalk(struct inode *ip, uint bn, int alloc)
 {
-  uint addr, *a;
+  uint addr, *a, n;
+  int level, i;
   struct buf *bp;
 
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0 && alloc){
+      // after a reopen, carry on from the previous block.
+      if(ip->goal == 0 && bn > 0)
+        ip->goal = ip->addrs[bn-1] + 1;
+      ip->addrs[bn] = addr = balloc(ip, ip->type == T_DIR);
+    }
     return addr;
   }
   bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+  // Find the tree that holds bn; n is the number of
+  // data blocks under its root.
+  n = NINDIRECT;
+  for(level = 1; level <= NLEVELS; level++){
+    if(bn < n)
+      break;
+    bn -= n;
+    n *= NINDIRECT;
+  }
+  if(level > NLEVELS)
+    panic("bmap: out of range");
+
+  if((addr = ip->addrs[NDIRECT+level-1]) == 0){
+    if(!alloc)
+      return 0;
+    ip->addrs[NDIRECT+level-1] = addr = balloc(ip, 1);
+  }
+
+  // Walk down one index block per level, allocating as needed.
+  for(; level > 0; level--){
+    n /= NINDIRECT;
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    i = bn / n;
+    bn %= n;
+    if((addr = a[i]) == 0 && alloc){
+      if(ip->goal == 0 && level == 1 && i > 0)
+        ip->goal = a[i-1] + 1;
+      a[i] = addr = balloc(ip, level > 1 || ip->type == T_DIR);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    if(addr == 0)
+      return 0;
   }
+  return addr;
+}
 
-  panic("bmap: out of range");
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  return bwalk(ip, bn, 1);
 }
 
-// Truncate inode (discard contents).
-// Caller must hold ip->lock.
-void
-itrunc(struct inode *ip)
+// A big file's blocks can be spread over more bitmap blocks
+// than one transaction may log, so itrunc() frees them in
+// steps, each touching at most TRUNCBMAPS bitmap blocks.
+// A step that stops inside a tree also logs the index blocks
+// on the path to where it stopped, so it dirties no more than
+// TRUNCBMAPS + NLEVELS + 1 blocks.
+#define TRUNCBMAPS 4
+struct tstep {
+  int n;
+  uint bmap[TRUNCBMAPS];
+};
+
+// May this step free block b? Adds b's bitmap block to ts.
+static int
+tstepadd(struct tstep *ts, uint b)
+{
+  int i;
+
+  for(i = 0; i < ts->n; i++)
+    if(ts->bmap[i] == BBLOCK(b, sb))
+      return 1;
+  if(ts->n == TRUNCBMAPS)
+    return 0;
+  ts->bmap[ts->n++] = BBLOCK(b, sb);
+  return 1;
+}
+
+// Free the tree whose root is *ap, an index block level levels
+// above the data, or a data block if level is 0, and zero *ap.
+// Returns 0 if ts filled up first; the index blocks then say
+// what is left.
+static int
+bfreetree(uint dev, uint *ap, int level, struct tstep *ts)
 {
-  int i, j;
   struct buf *bp;
   uint *a;
+  int j, freed;
 
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
-    }
-  }
-
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+  if(level > 0){
+    bp = bread(dev, *ap);
     a = (uint*)bp->data;
+    freed = 0;
     for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+      if(a[j] == 0)
+        continue;
+      if(!bfreetree(dev, &a[j], level-1, ts))
+        break;
+      freed = 1;
+    }
+    if(j < NINDIRECT || !tstepadd(ts, *ap)){
+      if(freed)
+        log_write(bp);
+      brelse(bp);
+      return 0;
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+  } else if(!tstepadd(ts, *ap)){
+    return 0;
   }
+  bfree(dev, *ap);
+  *ap = 0;
+  return 1;
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock, and be in a transaction. If
+// the blocks take more than one step to free, itrunc() ends
+// the caller's transaction and starts another for each step,
+// releasing ip->lock in between so as not to hold up the
+// commit. The inode is consistent on disk after each step;
+// if the system crashes part way, what is left stays in the
+// file, or, if it had no links, is freed by ireclaim().
+void
+itrunc(struct inode *ip)
+{
+  struct tstep ts;
+  int i, n;
 
   ip->size = 0;
-  iupdate(ip);
+  bunreserve(ip);
+  ip->goal = 0;
+  for(;;){
+    ts.n = 0;
+    for(i = 0; i < NDIRECT+NLEVELS; i++){
+      if(ip->addrs[i] &&
+         !bfreetree(ip->dev, &ip->addrs[i], i < NDIRECT ? 0 : i-NDIRECT+1, &ts))
+        break;
+    }
+    iupdate(ip);
+    if(i == NDIRECT+NLEVELS)
+      break;
+    n = myproc()->logres;
+    iunlock(ip);
+    end_op();
+    begin_opn(n);
+    ilock(ip);
+    // a write may have come in while ip was unlocked.
+    ip->size = 0;
+    bunreserve(ip);
+    ip->goal = 0;
+  }
 }
 
 // Copy stat information from inode.
@@ -476,6 +906,47 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// How many index blocks lie on the path to data block bn.
+static int
+bdepth(uint bn)
+{
+  uint n;
+  int level;
+
+  if(bn < NDIRECT)
+    return 0;
+  bn -= NDIRECT;
+  n = NINDIRECT;
+  for(level = 1; level < NLEVELS; level++){
+    if(bn < n)
+      break;
+    bn -= n;
+    n *= NINDIRECT;
+  }
+  return level;
+}
+
+// How many log blocks a writei() of n bytes at off may dirty,
+// for begin_opn(): each data block in the range (log_data()
+// may have to log it), the index blocks on the paths to both
+// ends, a bitmap block for each of those that gets allocated
+// but no more than there are bitmap blocks, and the inode.
+// n must be at most WRITEBLOCKS*BSIZE, so that the range
+// crosses no more than one index block boundary per level.
+int
+writeblocks(uint off, uint n)
+{
+  uint first, last;
+  int nb;
+
+  if(n == 0 || off + n < off)
+    return 1;
+  first = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+  nb = last - first + 1 + bdepth(first) + bdepth(last);
+  return nb + min(nb, hint.nbmap) + 1;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -491,7 +962,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if(off + n > (uint64)MAXFILE*BSIZE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
@@ -501,7 +972,11 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
-    log_write(bp);
+    // directories are metadata; other file data is ordered.
+    if(ip->type == T_DIR)
+      log_write(bp);
+    else
+      log_data(bp);
     brelse(bp);
   }
 
@@ -516,6 +991,40 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// Copy up to n bytes from src at srcoff to dst at dstoff,
+// block by block through the buffer cache, with no
+// intermediate copy. Stops early at the end of src.
+// Caller must hold both inode locks and be inside a
+// transaction with room for the destination blocks.
+// Returns the number of bytes copied, or -1.
+int
+copyi(struct inode *src, uint srcoff, struct inode *dst, uint dstoff, uint n)
+{
+  uint tot, m;
+  int r;
+  struct buf *bp;
+
+  if(srcoff > src->size || srcoff + n < srcoff)
+    return 0;
+  if(srcoff + n > src->size)
+    n = src->size - srcoff;
+
+  for(tot=0; tot<n; tot+=m, srcoff+=m, dstoff+=m){
+    bp = bread(src->dev, bmap(src, srcoff/BSIZE));
+    m = min(n - tot, BSIZE - srcoff%BSIZE);
+    r = writei(dst, 0, (uint64)(bp->data + srcoff%BSIZE), dstoff, m);
+    brelse(bp);
+    if(r != m){
+      if(r > 0)
+        tot += r;
+      else if(tot == 0)
+        tot = -1;
+      break;
+    }
+  }
+  return tot;
+}
+
 // Directories
 
 int
@@ -524,32 +1033,425 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Name cache.
+//
+// Remembers the results of recent dirlookup()s: for a name in
+// a directory, either the inode number and offset of its entry,
+// or that there is no such entry (inum 0). Entries are hashed
+// on (dev, directory inum, name) and recycled least recently
+// used first. Everything that changes a directory keeps the
+// cache up to date while holding the directory's lock: dirlink()
+// enters the new name, dirunlink() forgets the old one, and iput()
+// drops all entries of a directory it frees.
+
+#define NDENTRY 128
+#define NDHASH  61
+
+struct dentry {
+  uint dev;
+  uint dir;             // inum of the directory
+  char name[DIRSIZ];
+  uint inum;            // 0: name is not in dir
+  uint off;             // offset of the dirent, if inum != 0
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list, most recently used at head.next
+  struct dentry *next;
+  int hashed;           // on a hash chain?
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry *hash[NDHASH];
+  struct dentry head;
+  struct dentry dentry[NDENTRY];
+} dcache;
+
+void
+dcinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry + NDENTRY; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in dir.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->hnext){
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Move d to the most recently used end of the list.
+static void
+dtouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Take d out of its hash chain.
+// Caller must hold dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  if(!d->hashed)
+    return;
+  for(pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp != d; pp = &(*pp)->hnext)
+    ;
+  *pp = d->hnext;
+  d->hashed = 0;
+}
+
+// Remember that name in dp is inode inum at offset off,
+// or not there at all if inum is 0.
+static void
+dcenter(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    d = dcache.head.prev;
+    dunhash(d);
+    d->dev = dp->dev;
+    d->dir = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(d->dev, d->dir, d->name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+    d->hashed = 1;
+  }
+  d->inum = inum;
+  d->off = off;
+  dtouch(d);
+  release(&dcache.lock);
+}
+
+// Forget whatever is known about name in dp.
+// Caller must hold dp->lock.
+static void
+dcforget(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) != 0)
+    dunhash(d);
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dir, which is being freed.
+static void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry + NDENTRY; d++){
+    if(d->hashed && d->dev == dev && d->dir == dir)
+      dunhash(d);
+  }
+  release(&dcache.lock);
+}
+
+// Hashed directories.
+//
+// The dirents of every directory form the plain array that
+// read() returns. Once a directory has DIRHASHMIN dirents,
+// dirlink() also gives it a hash index (see fs.h), in blocks
+// that only the triply-indirect tree reaches, so a directory has
+// an index exactly when it has that tree. The index maps the
+// hash of each name to its dirent number. It covers the dirents
+// below hd->nindexed; each dirlink() indexes a few more, so that
+// no one transaction has to write the whole index, and lookups
+// scan the unindexed tail linearly.
+
+#define DHCATCHUP 2   // older dirents indexed per dirlink()
+
+// FNV-1a; must match dirhash() in mkfs.
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+static int
+dirhashed(struct inode *dp)
+{
+  return dp->addrs[NDIRECT+NLEVELS-1] != 0;
+}
+
+// Return the number of dirents in dp's index.
+static uint
+dhindexed(struct inode *dp)
+{
+  struct buf *bp;
+  uint n;
+
+  bp = bread(dp->dev, bmap(dp, DIRHASHBLK));
+  n = ((struct dhhead*)bp->data)->nindexed;
+  brelse(bp);
+  return n;
+}
+
+// Return the index block after the one with buffer bp in
+// its chain, or 0 if there is none.
+static uint
+dhnext(struct buf *bp)
+{
+  uint next = ((struct dhblock*)bp->data)->next;
+
+  return next ? 1 + NDHBUCKET + next - 1 : 0;
+}
+
+// Look name up in dp's index. If it is there, set *poff to
+// the offset of its dirent and return its inode number.
+static uint
+dhlookup(struct inode *dp, char *name, uint *poff)
+{
+  struct buf *bp;
+  struct dhblock *blk;
+  struct dirent de;
+  uint h, bn, addr, off;
+  int i;
+
+  h = dirhash(name);
+  for(bn = 1 + h % NDHBUCKET; bn != 0; bn = dhnext(bp), brelse(bp)){
+    if((addr = bwalk(dp, DIRHASHBLK + bn, 0)) == 0)
+      break;
+    bp = bread(dp->dev, addr);
+    blk = (struct dhblock*)bp->data;
+    for(i = 0; i < NDHENT; i++){
+      if(blk->ent[i].slot == 0 || blk->ent[i].hash != h)
+        continue;
+      off = (blk->ent[i].slot - 1) * sizeof(de);
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dhlookup read");
+      if(de.inum != 0 && namecmp(name, de.name) == 0){
+        brelse(bp);
+        *poff = off;
+        return de.inum;
+      }
+    }
+  }
+  return 0;
+}
+
+// Record in dp's index that dirent number slot has a name
+// with hash h.
+static void
+dhinsert(struct inode *dp, uint h, uint slot)
+{
+  struct buf *bp, *hp;
+  struct dhblock *blk;
+  struct dhhead *hd;
+  uint bn;
+  int i;
+
+  for(bn = 1 + h % NDHBUCKET; ; bn = dhnext(bp), brelse(bp)){
+    bp = bread(dp->dev, bmap(dp, DIRHASHBLK + bn));
+    blk = (struct dhblock*)bp->data;
+    for(i = 0; i < NDHENT; i++){
+      if(blk->ent[i].slot == 0){
+        blk->ent[i].hash = h;
+        blk->ent[i].slot = slot + 1;
+        log_write(bp);
+        brelse(bp);
+        return;
+      }
+    }
+    if(blk->next == 0){
+      // chain a new overflow block onto the bucket.
+      hp = bread(dp->dev, bmap(dp, DIRHASHBLK));
+      hd = (struct dhhead*)hp->data;
+      blk->next = ++hd->noverflow;
+      log_write(hp);
+      brelse(hp);
+      log_write(bp);
+    }
+  }
+}
+
+// Remove dirent number slot, whose name has hash h, from
+// dp's index.
+static void
+dhremove(struct inode *dp, uint h, uint slot)
+{
+  struct buf *bp;
+  struct dhblock *blk;
+  uint bn, addr;
+  int i;
+
+  for(bn = 1 + h % NDHBUCKET; bn != 0; bn = dhnext(bp), brelse(bp)){
+    if((addr = bwalk(dp, DIRHASHBLK + bn, 0)) == 0)
+      break;
+    bp = bread(dp->dev, addr);
+    blk = (struct dhblock*)bp->data;
+    for(i = 0; i < NDHENT; i++){
+      if(blk->ent[i].slot == slot + 1){
+        blk->ent[i].slot = 0;
+        log_write(bp);
+        brelse(bp);
+        return;
+      }
+    }
+  }
+  panic("dhremove");
+}
+
+// Add up to n more of dp's dirents to its index, starting
+// the index if dp is big enough to need one.
+// Caller must hold dp->lock and be in a transaction.
+static void
+dhcatchup(struct inode *dp, int n)
+{
+  struct buf *hp;
+  struct dhhead *hd;
+  struct dirent de;
+  uint slot, nslot;
+
+  nslot = dp->size / sizeof(de);
+  if(!dirhashed(dp) && nslot < DIRHASHMIN)
+    return;
+
+  hp = bread(dp->dev, bmap(dp, DIRHASHBLK));
+  hd = (struct dhhead*)hp->data;
+  slot = hd->nindexed;
+  brelse(hp);
+  if(slot >= nslot)
+    return;
+
+  for(; slot < nslot && n > 0; slot++, n--){
+    if(readi(dp, 0, (uint64)&de, slot * sizeof(de), sizeof(de)) != sizeof(de))
+      panic("dhcatchup read");
+    if(de.inum != 0)
+      dhinsert(dp, dirhash(de.name), slot);
+  }
+
+  hp = bread(dp->dev, bmap(dp, DIRHASHBLK));
+  ((struct dhhead*)hp->data)->nindexed = slot;
+  log_write(hp);
+  brelse(hp);
+  iupdate(dp);
+}
+
+// Scan dp's dirents from offset off on, in place in each
+// block, for the entry for name, or for a free entry if name
+// is 0. Returns the entry's offset and sets *pinum, or
+// returns -1 if there is none.
+static int
+dirscan(struct inode *dp, uint off, char *name, uint *pinum)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint end;
+
+  for(; off < dp->size; off = end){
+    end = min(dp->size, (off / BSIZE + 1) * BSIZE);
+    bp = bread(dp->dev, bmap(dp, off / BSIZE));
+    for(; off < end; off += sizeof(*de)){
+      de = (struct dirent*)(bp->data + off % BSIZE);
+      if(name ? de->inum != 0 && namecmp(name, de->name) == 0 : de->inum == 0){
+        if(pinum)
+          *pinum = de->inum;
+        brelse(bp);
+        return off;
+      }
+    }
+    brelse(bp);
+  }
+  return -1;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
-  struct dirent de;
+  int r;
+  struct dentry *d;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) != 0){
+    dtouch(d);
+    inum = d->inum;
+    off = d->off;
+    release(&dcache.lock);
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+  release(&dcache.lock);
+
+  off = 0;
+  if(dirhashed(dp)){
+    if((inum = dhlookup(dp, name, &off)) != 0)
+      goto found;
+    off = dhindexed(dp) * sizeof(struct dirent);
+  }
+
+  if((r = dirscan(dp, off, name, &inum)) >= 0){
+    off = r;
+    goto found;
   }
 
+  dcenter(dp, name, 0, 0);
   return 0;
+
+found:
+  if(poff)
+    *poff = off;
+  dcenter(dp, name, inum, off);
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -566,22 +1468,44 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
-  }
+  // Look for an empty dirent, or else append one.
+  if((off = dirscan(dp, dp->dfree, 0, 0)) < 0)
+    off = dp->size;
+  dp->dfree = off + sizeof(de);
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcenter(dp, name, inum, off);
+
+  if(dirhashed(dp) && off / sizeof(de) < dhindexed(dp))
+    dhinsert(dp, dirhash(de.name), off / sizeof(de));
+  dhcatchup(dp, DHCATCHUP);
 
   return 0;
 }
 
+// Remove the entry for name, at offset off, from directory dp.
+// Caller must hold dp->lock and be in a transaction.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink read");
+  if(dirhashed(dp) && off / sizeof(de) < dhindexed(dp))
+    dhremove(dp, dirhash(de.name), off / sizeof(de));
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+  if(off < dp->dfree)
+    dp->dfree = off;
+  dcforget(dp, name);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -629,11 +1553,16 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct fdtable *fdt;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    fdt = myproc()->fdt;
+    acquire(&fdt->lock);
+    ip = idup(fdt->cwd);
+    release(&fdt->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -24,9 +24,15 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+// addrs[] holds NDIRECT direct blocks followed by the roots
+// of NLEVELS trees of index blocks: singly, doubly and triply
+// indirect.
+#define NDIRECT 10
+#define NLEVELS 3
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +41,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+NLEVELS];   // Data block addresses
 };
 
 // Inodes per block.
@@ -58,3 +64,27 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+
+// A directory with many entries also has a hash index, in file
+// blocks DIRHASHBLK and up, far past the end of its dirents.
+// Block DIRHASHBLK holds a struct dhhead, the next NDHBUCKET
+// blocks are the heads of the bucket chains, and overflow
+// blocks follow those.
+#define DIRHASHBLK  (NDIRECT + NINDIRECT + NDINDIRECT)
+#define DIRHASHMIN  128     // dirents before the kernel adds an index
+#define NDHBUCKET   64
+#define NDHENT      (BSIZE / (2 * sizeof(uint)) - 1)
+
+struct dhhead {
+  uint nindexed;        // dirents [0, nindexed) are in the index
+  uint noverflow;       // overflow blocks in use
+};
+
+struct dhblock {
+  struct {
+    uint hash;
+    uint slot;          // 1 + dirent number; 0 if free
+  } ent[NDHENT];
+  uint next;            // 1 + overflow block number; 0 at the end
+  uint pad;
+};
@@ -0,0 +1,7 @@
+#define IOV_MAX   16  // max buffers per readv() or writev()
+
+// One buffer of a readv() or writev() request.
+struct iovec {
+  void *iov_base;  // Start of buffer
+  uint64 iov_len;  // Size of buffer in bytes
+};
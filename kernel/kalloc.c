@@ -18,9 +18,17 @@ struct run {
   struct run *next;
 };
 
+// Free pages live on one of two lists. freelist holds pages
+// with arbitrary contents; zerolist holds pages that are known
+// to be all zeroes, filled by kzero_pages() when a CPU is idle.
+// kalloc() prefers dirty pages and kalloc_zeroed() prefers
+// zeroed ones, so most callers that need a clean page
+// (page tables, fresh user memory) never zero it themselves.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  struct run *zerolist;
+  int nzero;            // number of pages on zerolist
 } kmem;
 
 void
@@ -51,8 +59,10 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+#ifdef KJUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
@@ -62,21 +72,95 @@ kfree(void *pa)
   release(&kmem.lock);
 }
 
+// Take a page off the free lists. Prefers zerolist if zero
+// is set and freelist otherwise, falling back to the other.
+// Sets *zeroed if the page came from zerolist.
+static struct run*
+takepage(int zero, int *zeroed)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  *zeroed = 0;
+  if(zero && kmem.zerolist){
+    r = kmem.zerolist;
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    *zeroed = 1;
+  } else if((r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+  } else if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    *zeroed = 1;
+  }
+  release(&kmem.lock);
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// The contents of the page are undefined.
 void *
 kalloc(void)
 {
   struct run *r;
+  int zeroed;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
-
+  r = takepage(0, &zeroed);
+#ifdef KJUNK
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
   return (void*)r;
 }
+
+// Allocate one zero-filled 4096-byte page of physical memory.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+  int zeroed;
+
+  r = takepage(1, &zeroed);
+  if(r){
+    if(zeroed)
+      r->next = 0;  // the only word the free list dirtied.
+    else
+      memset((char*)r, 0, PGSIZE);
+  }
+  return (void*)r;
+}
+
+// Zero up to n dirty free pages and move them to the zeroed
+// pool, stopping once the pool holds KZEROPOOL pages.
+// The zeroing itself is done without holding kmem.lock.
+// Called from the scheduler when it has nothing to run.
+// Returns the number of pages zeroed.
+int
+kzero_pages(int n)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < n; i++){
+    acquire(&kmem.lock);
+    if(kmem.nzero >= KZEROPOOL || (r = kmem.freelist) == 0){
+      release(&kmem.lock);
+      break;
+    }
+    kmem.freelist = r->next;
+    release(&kmem.lock);
+
+    memset((char*)r, 0, PGSIZE);
+
+    acquire(&kmem.lock);
+    r->next = kmem.zerolist;
+    kmem.zerolist = r;
+    kmem.nzero++;
+    release(&kmem.lock);
+  }
+  return i;
+}
@@ -6,6 +6,9 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "file.h"
+#include "proc.h"
+#include "logstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -16,11 +19,16 @@
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
+// its start and end. begin_op() reserves room in the log for
+// MAXOPBLOCKS blocks, or begin_opn() for as many as the caller
+// says it may write. Usually that just adds to the space
+// reserved by in-progress FS system calls and returns.
+// But if the log is too full to hold the reservation, it
 // sleeps until the last outstanding end_op() commits.
 //
+// The size of the log comes from the superblock, so mkfs
+// decides how many operations can share a commit.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -29,22 +37,49 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Data blocks of regular files are not logged (ordered mode):
+// log_data() writes them in place before the transaction that
+// points the file at them commits, so a crash leaves either the
+// old file or the new one with its data, never a file pointing
+// at garbage. The exception is a block freed earlier in the same
+// transaction, which the disk still counts as part of the old
+// file until the commit; its new contents go through the log.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
+#define LOGMAX ((int)(BSIZE / sizeof(int)) - 1)  // blocks a header can list
+#define NFREED 16
+#define NLOGHASH 64
+
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int block[LOGMAX];
 };
 
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int max;         // most blocks one transaction may log
+  int reserved;    // blocks reserved by executing FS sys calls
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+  // for absorption: the slots of lh.block[] hashed on block
+  // number, chained through hnext; -1 ends a chain.
+  short hhead[NLOGHASH];
+  short hnext[LOGMAX];
+  struct logstat stat;
+  // blocks freed by the running transaction, as runs
+  // [start, end); freedall if there were too many runs.
+  int nfreed;
+  int freedall;
+  struct {
+    uint start;
+    uint end;
+  } freed[NFREED];
 };
 struct log log;
 
@@ -54,13 +89,28 @@ static void commit();
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+
+  // the header block comes first; every logged block stays
+  // pinned in the buffer cache until the commit, so leave
+  // room there for blocks that are only being read. there
+  // must be room for the largest reservation an operation
+  // makes, which for file writes is WRITEOPBLOCKS.
+  log.max = log.size - 1;
+  if(log.max > LOGMAX)
+    log.max = LOGMAX;
+  if(log.max > NBUF - 2*MAXOPBLOCKS)
+    log.max = NBUF - 2*MAXOPBLOCKS;
+  if(log.max < (WRITEOPBLOCKS > MAXOPBLOCKS ? WRITEOPBLOCKS : MAXOPBLOCKS))
+    panic("initlog: log too small");
+  log.stat.size = log.max;
+  memset(log.hhead, -1, sizeof(log.hhead));
   recover_from_log();
 }
 
@@ -126,15 +176,33 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the start of an FS system call that
+// may write up to n blocks.
+void
+begin_opn(int n)
+{
+  int waited = 0;
+
+  if(n > log.max)
+    panic("begin_opn: too big");
+
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > log.max){
       // this op might exhaust log space; wait for commit.
+      waited = 1;
       sleep(&log, &log.lock);
     } else {
+      log.stat.ops++;
+      log.stat.waits += waited;
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
@@ -147,17 +215,25 @@ void
 end_op(void)
 {
   int do_commit = 0;
+  uint t0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= myproc()->logres;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
     do_commit = 1;
     log.committing = 1;
+    if(log.lh.n > 0){
+      log.stat.commits++;
+      log.stat.logged += log.lh.n;
+      if(log.lh.n > log.stat.maxlogged)
+        log.stat.maxlogged = log.lh.n;
+    }
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
+    // and decrementing log.reserved has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
@@ -166,8 +242,15 @@ end_op(void)
   if(do_commit){
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
+    acquire(&tickslock);
+    t0 = ticks;
+    release(&tickslock);
     commit();
+    acquire(&tickslock);
+    t0 = ticks - t0;
+    release(&tickslock);
     acquire(&log.lock);
+    log.stat.ticks += t0;
     log.committing = 0;
     wakeup(&log);
     release(&log.lock);
@@ -199,7 +282,10 @@ commit()
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    memset(log.hhead, -1, sizeof(log.hhead));
   }
+  log.nfreed = 0;
+  log.freedall = 0;
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -214,23 +300,91 @@ commit()
 void
 log_write(struct buf *b)
 {
-  int i;
+  int i, h;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
+  h = b->blockno % NLOGHASH;
+  for (i = log.hhead[h]; i >= 0; i = log.hnext[i]) {
     if (log.lh.block[i] == b->blockno)   // log absorption
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  if (i >= 0) {
+    log.stat.absorbed++;
+  } else {  // Add new block to log
+    if (log.lh.n >= log.max)
+      panic("too big a transaction");
+    i = log.lh.n++;
+    log.lh.block[i] = b->blockno;
+    log.hnext[i] = log.hhead[h];
+    log.hhead[h] = i;
     bpin(b);
-    log.lh.n++;
   }
   release(&log.lock);
 }
 
+
+// Record that the running transaction freed block blockno.
+void
+log_freed(uint blockno)
+{
+  int i;
+
+  acquire(&log.lock);
+  for(i = 0; i < log.nfreed; i++){
+    if(log.freed[i].end == blockno){
+      log.freed[i].end++;
+      break;
+    }
+    if(log.freed[i].start == blockno + 1){
+      log.freed[i].start--;
+      break;
+    }
+  }
+  if(i == log.nfreed){
+    if(log.nfreed < NFREED){
+      log.freed[i].start = blockno;
+      log.freed[i].end = blockno + 1;
+      log.nfreed++;
+    } else {
+      log.freedall = 1;
+    }
+  }
+  release(&log.lock);
+}
+
+// Caller has modified data block b of a regular file and
+// is done with the buffer. Write it to its home location
+// now, unless the running transaction freed it earlier,
+// in which case log it like metadata.
+void
+log_data(struct buf *b)
+{
+  int i, freed;
+
+  acquire(&log.lock);
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+  freed = log.freedall;
+  for(i = 0; i < log.nfreed && !freed; i++)
+    freed = log.freed[i].start <= b->blockno && b->blockno < log.freed[i].end;
+  if(!freed)
+    log.stat.ordered++;
+  release(&log.lock);
+
+  if(freed)
+    log_write(b);
+  else
+    bwrite(b);
+}
+
+// Copy the log statistics to *st.
+void
+log_stat(struct logstat *st)
+{
+  acquire(&log.lock);
+  *st = log.stat;
+  release(&log.lock);
+}
@@ -0,0 +1,13 @@
+// File system log statistics, as returned by logstat().
+// All counts are since boot.
+struct logstat {
+  uint64 ops;        // operations (begin_op() calls)
+  uint64 waits;      // operations that waited for log space
+  uint64 commits;    // transactions committed
+  uint64 logged;     // blocks written to the log
+  uint64 absorbed;   // log_write()s of a block already in the transaction
+  uint64 ordered;    // file data blocks written in place
+  uint64 ticks;      // clock ticks spent committing
+  uint maxlogged;    // blocks in the largest transaction
+  uint size;         // most blocks one transaction may log
+};
@@ -62,6 +62,9 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   ...
+//   trapframes of threads sharing the address space
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define TRAPFRAMEAT(slot) (TRAPFRAME - (uint64)(slot)*PGSIZE)
@@ -0,0 +1,30 @@
+#define VMASIZE 16
+struct
+    vma
+{
+  int valid;
+  uint64 addr;
+  int len;
+  struct file *f;
+  int prot;
+  int flags;
+  int fd;
+  int offset;
+};
+
+// A user address space. Every thread of a process shares one;
+// each thread's trapframe is mapped at its own slot below
+// the trampoline (see TRAPFRAMEAT in memlayout.h).
+struct mm
+{
+  struct spinlock lock; // protects ref, nlive, tfslots and execing
+  int ref;              // Number of procs using this mm
+  int nlive;            // Number of those that have not exited
+  uint tfslots;         // Trapframe slots in use, one bit each
+  int execing;          // exec() is replacing it; no new threads
+
+  struct sleeplock vmlock; // protects sz and vma
+  pagetable_t pagetable;   // User page table
+  uint64 sz;               // Size of process memory (bytes)
+  struct vma vma[VMASIZE];
+};
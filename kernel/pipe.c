@@ -7,18 +7,97 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "iovec.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+// The pipe's data lives in a ring of whole pages, one page at
+// first. A writer that finds the ring full doubles it, up to
+// PIPEMAXPAGES, before it resorts to sleeping, so a pipe under
+// sustained traffic ends up with a large buffer. The ring size
+// is always a power of two, so nread and nwrite may wrap.
+#define PIPEMAXPAGES 16
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pages[PIPEMAXPAGES]; // the ring, npages pages long
+  int npages;
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int nrwait;     // number of readers sleeping for data
+  int nwwait;     // number of writers sleeping for space
+  int rbusy;      // a splice is copying out of the ring unlocked
+  int wbusy;      // a splice is copying into the ring unlocked
 };
 
+#define PIPESIZE(pi) ((uint)(pi)->npages * PGSIZE)
+
+// Address of the byte at ring position n.
+static char*
+pipeaddr(struct pipe *pi, uint n)
+{
+  n %= PIPESIZE(pi);
+  return pi->pages[n / PGSIZE] + n % PGSIZE;
+}
+
+// Double the ring of a full pipe. The pages are rotated so the
+// page holding the oldest byte comes first; the bytes that
+// shared that page with the newest data move to the first new
+// page. Returns 0 on success, -1 if the pipe can't grow.
+// Caller must hold pi->lock.
+static int
+pipegrow(struct pipe *pi)
+{
+  char *old[PIPEMAXPAGES], *new[PIPEMAXPAGES];
+  int i, n, first, off;
+
+  n = pi->npages;
+  if(2*n > PIPEMAXPAGES || pi->rbusy)
+    return -1;
+  for(i = 0; i < n; i++){
+    if((new[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(new[i]);
+      return -1;
+    }
+  }
+
+  first = (pi->nread % PIPESIZE(pi)) / PGSIZE;
+  off = pi->nread % PGSIZE;
+  memmove(old, pi->pages, n * sizeof(old[0]));
+  for(i = 0; i < n; i++)
+    pi->pages[i] = old[(first + i) % n];
+  for(i = 0; i < n; i++)
+    pi->pages[n + i] = new[i];
+  memmove(pi->pages[n], pi->pages[0], off);
+
+  pi->nwrite = off + (pi->nwrite - pi->nread);
+  pi->nread = off;
+  pi->npages = 2*n;
+  return 0;
+}
+
+// Wake readers sleeping for data, and poll()ers.
+// Caller must hold pi->lock.
+static void
+wakereaders(struct pipe *pi)
+{
+  if(pi->nrwait)
+    wakeup(&pi->nread);
+  pollwakeup();
+}
+
+// Wake writers sleeping for space, and poll()ers.
+// Caller must hold pi->lock.
+static void
+wakewriters(struct pipe *pi)
+{
+  if(pi->nwwait)
+    wakeup(&pi->nwrite);
+  pollwakeup();
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,10 +109,17 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  if((pi->pages[0] = kalloc()) == 0)
+    goto bad;
+  pi->npages = 1;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->nrwait = 0;
+  pi->nwwait = 0;
+  pi->rbusy = 0;
+  pi->wbusy = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -58,6 +144,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *pi, int writable)
 {
+  int i;
+
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
@@ -66,17 +154,25 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup();
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(i = 0; i < pi->npages; i++)
+      kfree(pi->pages[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Copy as much of n bytes at user address addr into the pipe
+// as fits, one contiguous piece of the ring per copyin().
+// If nonblock is set, returns what fit rather than waiting
+// for room, or -1 if nothing did.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int nonblock, uint64 addr, int n)
 {
   int i = 0;
+  uint m, room;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,46 +181,260 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+    if(pi->wbusy){
+      sleep(&pi->wbusy, &pi->lock);
+      continue;
+    }
+    room = PIPESIZE(pi) - (pi->nwrite - pi->nread);
+    if(room == 0){ //DOC: pipewrite-full
+      if(pipegrow(pi) == 0)
+        continue;
+      if(nonblock)
+        break;
+      wakereaders(pi);
+      pi->nwwait++;
       sleep(&pi->nwrite, &pi->lock);
+      pi->nwwait--;
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      m = n - i;
+      if(m > room)
+        m = room;
+      if(m > PGSIZE - pi->nwrite % PGSIZE)
+        m = PGSIZE - pi->nwrite % PGSIZE;
+      if(copyin(pr->pagetable, pipeaddr(pi, pi->nwrite), addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      pi->nwrite += m;
+      i += m;
     }
   }
-  wakeup(&pi->nread);
+  if(i > 0)
+    wakereaders(pi);
   release(&pi->lock);
 
+  if(nonblock && i == 0 && n > 0)
+    return -1;
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int nonblock, uint64 addr, int n)
 {
-  int i;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return pipereadv(pi, nonblock, &iov, 1);
+}
+
+// Read into the niov user buffers described by iov, in order.
+// Waits until the pipe has data, then copies what is there
+// without waiting again. If nonblock is set, an empty pipe
+// with a writer returns -1 instead of waiting.
+int
+pipereadv(struct pipe *pi, int nonblock, struct iovec *iov, int niov)
+{
+  int i, v;
+  uint m, n;
+  uint64 addr;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen)){  //DOC: pipe-empty
     if(pr->killed){
       release(&pi->lock);
       return -1;
     }
+    if(nonblock){
+      release(&pi->lock);
+      return -1;
+    }
+    if(pi->rbusy){
+      sleep(&pi->rbusy, &pi->lock);
+      continue;
+    }
+    pi->nrwait++;
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    pi->nrwait--;
+  }
+  i = 0;
+  for(v = 0; v < niov; v++){
+    addr = (uint64)iov[v].iov_base;
+    n = iov[v].iov_len;
+    for(m = 0; n > 0; n -= m, addr += m){  //DOC: piperead-copy
+      if(pi->nread == pi->nwrite)
+        goto done;
+      m = n;
+      if(m > pi->nwrite - pi->nread)
+        m = pi->nwrite - pi->nread;
+      if(m > PGSIZE - pi->nread % PGSIZE)
+        m = PGSIZE - pi->nread % PGSIZE;
+      if(copyout(pr->pagetable, addr, pipeaddr(pi, pi->nread), m) == -1)
+        goto done;
+      pi->nread += m;
+      i += m;
+    }
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
+done:
+  if(i > 0)
+    wakewriters(pi);  //DOC: piperead-wakeup
+  release(&pi->lock);
+  return i;
+}
+
+// Report which of POLLIN, POLLOUT and POLLHUP hold for the
+// read end of the pipe, or the write end if writable is set.
+int
+pipepoll(struct pipe *pi, int writable)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if(writable){
+    if(!pi->readopen)
+      r |= POLLHUP | POLLOUT;  // a write fails at once
+    else if(pi->nwrite - pi->nread < PIPESIZE(pi) || 2*pi->npages <= PIPEMAXPAGES)
+      r |= POLLOUT;
+  } else {
+    if(!pi->writeopen)
+      r |= POLLHUP | POLLIN;   // a read returns at once
+    else if(pi->nread != pi->nwrite)
+      r |= POLLIN;
+  }
+  release(&pi->lock);
+  return r;
+}
+
+// Splice: move up to n bytes from the inode file f into the
+// pipe, with readi() copying straight from the buffer cache
+// into the ring. Advances f->off. Like pipewrite(), waits
+// for room in the pipe; stops early at end of file.
+// Returns the number of bytes moved, or -1.
+int
+pipesplicein(struct pipe *pi, struct file *f, int n)
+{
+  int i = 0, r;
+  uint m, room;
+  char *dst;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(i < n){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(pi->wbusy){
+      sleep(&pi->wbusy, &pi->lock);
+      continue;
+    }
+    room = PIPESIZE(pi) - (pi->nwrite - pi->nread);
+    if(room == 0){
+      if(pipegrow(pi) == 0)
+        continue;
+      wakereaders(pi);
+      pi->nwwait++;
+      sleep(&pi->nwrite, &pi->lock);
+      pi->nwwait--;
+      continue;
+    }
+    m = n - i;
+    if(m > room)
+      m = room;
+    if(m > PGSIZE - pi->nwrite % PGSIZE)
+      m = PGSIZE - pi->nwrite % PGSIZE;
+    dst = pipeaddr(pi, pi->nwrite);
+
+    // readi() may sleep, so fill the ring without pi->lock.
+    // wbusy keeps other writers out, and readers never look
+    // past nwrite.
+    pi->wbusy = 1;
+    release(&pi->lock);
+    ilock(f->ip);
+    if((r = readi(f->ip, 0, (uint64)dst, f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    acquire(&pi->lock);
+    pi->wbusy = 0;
+    wakeup(&pi->wbusy);
+
+    if(r <= 0)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    pi->nwrite += r;
+    i += r;
+    wakereaders(pi);
+  }
+  release(&pi->lock);
+  return i;
+}
+
+// Splice: move up to n bytes from the pipe into the inode
+// file f, with writei() copying straight out of the ring.
+// Advances f->off. Like piperead(), waits until the pipe
+// has data, then moves what is there without waiting again.
+// Returns the number of bytes moved, or -1.
+int
+pipespliceout(struct pipe *pi, struct file *f, int n)
+{
+  int i = 0, r = 0;
+  uint m;
+  char *src;
+  struct proc *pr = myproc();
+  // same per-transaction limit as filewrite().
+  int max = WRITEBLOCKS * BSIZE;
+
+  acquire(&pi->lock);
+  while(i < n){
+    if(pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(pi->rbusy){
+      sleep(&pi->rbusy, &pi->lock);
+      continue;
+    }
+    if(pi->nread == pi->nwrite){
+      if(i > 0 || !pi->writeopen)
+        break;
+      pi->nrwait++;
+      sleep(&pi->nread, &pi->lock);
+      pi->nrwait--;
+      continue;
+    }
+    m = n - i;
+    if(m > pi->nwrite - pi->nread)
+      m = pi->nwrite - pi->nread;
+    if(m > PGSIZE - pi->nread % PGSIZE)
+      m = PGSIZE - pi->nread % PGSIZE;
+    if(m > max)
+      m = max;
+    src = pipeaddr(pi, pi->nread);
+
+    // writei() may sleep, so drain the ring without pi->lock.
+    // rbusy keeps other readers out and stops pipegrow()
+    // from rearranging the pages.
+    pi->rbusy = 1;
+    release(&pi->lock);
+    begin_opn(writeblocks(f->off, m));
+    ilock(f->ip);
+    if((r = writei(f->ip, 0, (uint64)src, f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    end_op();
+    acquire(&pi->lock);
+    pi->rbusy = 0;
+    wakeup(&pi->rbusy);
+
+    if(r > 0){
+      pi->nread += r;
+      i += r;
+    }
+    if(r != m)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  if(i > 0)
+    wakewriters(pi);
   release(&pi->lock);
+  if(i == 0 && r < 0)
+    return -1;
   return i;
 }
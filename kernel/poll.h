@@ -0,0 +1,11 @@
+#define POLLIN    0x001  // there is data to read
+#define POLLOUT   0x004  // writing will not block
+#define POLLHUP   0x010  // the other end of a pipe is closed
+#define POLLNVAL  0x020  // fd is not open
+
+// One file descriptor for poll() to watch.
+struct pollfd {
+  int fd;          // File descriptor, or negative to skip
+  short events;    // Events of interest
+  short revents;   // Events that happened, filled in by poll()
+};
@@ -3,7 +3,9 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "mm.h"
 #include "defs.h"
 #include "fcntl.h"
 
@@ -11,13 +13,69 @@ struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// Address spaces. One is free when its ref is 0.
+static struct mm mms[NPROC];
+
+// File descriptor tables. One is free when its ref is 0.
+static struct fdtable fdts[NPROC];
+
 struct proc *initproc;
 
+// Per-CPU run queues. A process is on exactly one run queue
+// while it is RUNNABLE, so picking the next process to run is
+// O(1) and a CPU only touches the locks of the processes it
+// actually runs. A CPU whose own queue is empty steals from
+// the longest queue of another CPU.
+// Lock order: p->lock, then a run queue lock.
+struct runq
+{
+  struct spinlock lock;
+  struct proc *head; // next to run
+  struct proc *tail;
+  int n;             // number of processes on the queue
+  int online;        // this CPU has entered scheduler()
+};
+
+static struct runq runqs[NCPU];
+
+// Wait queues for sleep() and wakeup(), hashed by channel,
+// so that wakeup() only looks at processes sleeping on
+// channels in the same bucket instead of the whole proc[].
+// A sleeping process stays on its bucket's list until it
+// has woken up and removes itself in sleep().
+// Lock order: the sleep lock, then a wait queue lock,
+// then p->lock.
+#define NWAITQ 64
+
+struct waitq
+{
+  struct spinlock lock;
+  struct proc *head;
+};
+
+static struct waitq waitqs[NWAITQ];
+
+// Locks for futex_wait() and futex_wake(), hashed by the
+// physical address of the futex word. A waiter holds the
+// lock from reading the word until it is asleep, and a
+// waker takes it to wake, so no wakeup is lost in between.
+#define NFUTEX 16
+
+static struct spinlock futexlocks[NFUTEX];
+
+static struct waitq *
+waitq_for(void *chan)
+{
+  // Fibonacci hashing spreads nearby addresses apart.
+  return &waitqs[((uint64)chan * 0x9E3779B97F4A7C15ULL) >> 58];
+}
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void idle(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -51,11 +109,23 @@ void procinit(void)
 
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for (int i = 0; i < NCPU; i++)
+    initlock(&runqs[i].lock, "runq");
+  for (int i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
+  for (int i = 0; i < NFUTEX; i++)
+    initlock(&futexlocks[i], "futex");
   for (p = proc; p < &proc[NPROC]; p++)
   {
     initlock(&p->lock, "proc");
     p->kstack = KSTACK((int)(p - proc));
   }
+  for (int i = 0; i < NPROC; i++)
+  {
+    initlock(&mms[i].lock, "mm");
+    initsleeplock(&mms[i].vmlock, "vm");
+    initlock(&fdts[i].lock, "fdt");
+  }
 }
 
 // Must be called with interrupts disabled,
@@ -100,12 +170,246 @@ int allocpid()
   return pid;
 }
 
+// Append p to the tail of CPU id's run queue.
+static void
+runq_push(int id, struct proc *p)
+{
+  struct runq *rq = &runqs[id];
+
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if (rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  rq->n++;
+  release(&rq->lock);
+}
+
+// Remove and return the process at the head of
+// CPU id's run queue, or 0 if it is empty.
+static struct proc *
+runq_pop(int id)
+{
+  struct runq *rq = &runqs[id];
+  struct proc *p;
+
+  acquire(&rq->lock);
+  if ((p = rq->head) != 0)
+  {
+    rq->head = p->rqnext;
+    if (rq->head == 0)
+      rq->tail = 0;
+    p->rqnext = 0;
+    rq->n--;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Return the online CPU with the fewest queued processes.
+// The counts are read without locks; this is only a hint.
+static int
+runq_shortest(void)
+{
+  int id, best;
+
+  best = cpuid();
+  for (id = 0; id < NCPU; id++)
+    if (runqs[id].online && runqs[id].n < runqs[best].n)
+      best = id;
+  return best;
+}
+
+// Mark p RUNNABLE and put it on CPU id's run queue.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p, int id)
+{
+  p->state = RUNNABLE;
+  runq_push(id, p);
+}
+
+// Make p RUNNABLE on the current CPU's run queue.
+// Caller must hold p->lock.
+static void
+setrunnable_here(struct proc *p)
+{
+  push_off();
+  setrunnable(p, cpuid());
+  pop_off();
+}
+
+// Pick the next process for CPU id: the head of its own
+// run queue or, if that is empty, one stolen from the
+// CPU with the longest queue.
+static struct proc *
+runq_next(int id)
+{
+  struct proc *p;
+  int i, victim;
+
+  if ((p = runq_pop(id)) != 0)
+    return p;
+
+  victim = -1;
+  for (i = 0; i < NCPU; i++)
+    if (i != id && runqs[i].n > 0 && (victim < 0 || runqs[i].n > runqs[victim].n))
+      victim = i;
+  if (victim < 0)
+    return 0;
+  return runq_pop(victim);
+}
+
+// Give p a new, empty address space of its own,
+// with p's trapframe in slot 0.
+static int
+mmalloc(struct proc *p)
+{
+  struct mm *mm;
+
+  for (mm = mms; mm < &mms[NPROC]; mm++)
+  {
+    acquire(&mm->lock);
+    if (mm->ref == 0)
+      goto found;
+    release(&mm->lock);
+  }
+  return -1;
+
+found:
+  mm->ref = 1;
+  mm->nlive = 1;
+  mm->tfslots = 1;
+  mm->execing = 0;
+  release(&mm->lock);
+  mm->sz = 0;
+  memset(mm->vma, 0, sizeof(mm->vma));
+  p->mm = mm;
+  p->tfslot = 0;
+
+  // An empty user page table.
+  if ((p->pagetable = mm->pagetable = proc_pagetable(p)) == 0)
+    return -1;
+  return 0;
+}
+
+// Make p a thread in address space mm: take a free trapframe
+// slot and map p's trapframe there.
+static int
+mmshare(struct proc *p, struct mm *mm)
+{
+  int slot;
+
+  acquire(&mm->lock);
+  for (slot = 0; slot < NTHREAD; slot++)
+    if ((mm->tfslots & (1 << slot)) == 0)
+      break;
+  if (mm->execing || slot == NTHREAD ||
+      mappages(mm->pagetable, TRAPFRAMEAT(slot), PGSIZE,
+               (uint64)(p->trapframe), PTE_R | PTE_W) < 0)
+  {
+    release(&mm->lock);
+    return -1;
+  }
+  mm->tfslots |= 1 << slot;
+  mm->ref++;
+  mm->nlive++;
+  release(&mm->lock);
+  p->mm = mm;
+  p->pagetable = mm->pagetable;
+  p->tfslot = slot;
+  return 0;
+}
+
+// Drop p's hold on its address space, freeing the
+// page table and user memory if p was the last user.
+static void
+mmput(struct proc *p)
+{
+  struct mm *mm = p->mm;
+
+  acquire(&mm->lock);
+  if (mm->pagetable)
+    uvmunmap(mm->pagetable, TRAPFRAMEAT(p->tfslot), 1, 0);
+  mm->tfslots &= ~(1 << p->tfslot);
+  if (--mm->ref == 0 && mm->pagetable)
+  {
+    uvmunmap(mm->pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(mm->pagetable, mm->sz);
+    mm->pagetable = 0;
+    mm->sz = 0;
+  }
+  release(&mm->lock);
+}
+
+// Give p an empty file descriptor table of its own.
+static int
+fdtalloc(struct proc *p)
+{
+  struct fdtable *fdt;
+
+  for (fdt = fdts; fdt < &fdts[NPROC]; fdt++)
+  {
+    acquire(&fdt->lock);
+    if (fdt->ref == 0)
+    {
+      fdt->ref = 1;
+      release(&fdt->lock);
+      p->fdt = fdt;
+      return 0;
+    }
+    release(&fdt->lock);
+  }
+  return -1;
+}
+
+// Drop p's hold on its file descriptor table. The last
+// user closes the files and the current directory.
+static void
+fdtput(struct proc *p)
+{
+  struct fdtable *fdt = p->fdt;
+
+  p->fdt = 0;
+  acquire(&fdt->lock);
+  if (fdt->ref > 1)
+  {
+    fdt->ref--;
+    release(&fdt->lock);
+    return;
+  }
+  release(&fdt->lock);
+
+  // nobody else can reach fdt now.
+  for (int fd = 0; fd < NOFILE; fd++)
+  {
+    if (fdt->ofile[fd])
+    {
+      struct file *f = fdt->ofile[fd];
+      fileclose(f);
+      fdt->ofile[fd] = 0;
+    }
+  }
+  begin_op();
+  iput(fdt->cwd);
+  end_op();
+  fdt->cwd = 0;
+
+  acquire(&fdt->lock);
+  fdt->ref = 0;
+  release(&fdt->lock);
+}
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
+// The proc gets a new address space, or shares mm if
+// that is non-zero.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc *
-allocproc(void)
+allocproc(struct mm *mm)
 {
   struct proc *p;
 
@@ -135,9 +439,8 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if (p->pagetable == 0)
+  // An empty address space, or a share of mm's.
+  if ((mm ? mmshare(p, mm) : mmalloc(p)) < 0)
   {
     freeproc(p);
     release(&p->lock);
@@ -159,13 +462,13 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  if (p->mm)
+    mmput(p);
+  p->mm = 0;
+  p->pagetable = 0;
   if (p->trapframe)
     kfree((void *)p->trapframe);
   p->trapframe = 0;
-  if (p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -235,34 +538,37 @@ void userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
 
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;     // user program counter
   p->trapframe->sp = PGSIZE; // user stack pointer
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  if (fdtalloc(p) < 0)
+    panic("userinit: fdtalloc");
+  p->fdt->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable_here(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
+// Caller must hold p->mm->vmlock.
 int growproc(int n)
 {
   uint sz;
   struct proc *p = myproc();
 
-  sz = p->sz;
+  sz = p->mm->sz;
   if (n > 0)
   {
     if ((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
@@ -274,7 +580,7 @@ int growproc(int n)
   {
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  p->mm->sz = sz;
   return 0;
 }
 
@@ -287,19 +593,31 @@ int fork(void)
   struct proc *p = myproc();
 
   // Allocate process.
-  if ((np = allocproc()) == 0)
+  if ((np = allocproc(0)) == 0)
   {
     return -1;
   }
 
   // Copy user memory from parent to child.
-  if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0)
+  acquiresleep(&p->mm->vmlock);
+  if (uvmcopy(p->pagetable, np->pagetable, p->mm->sz) < 0 ||
+      fdtalloc(np) < 0)
   {
+    releasesleep(&p->mm->vmlock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
+  np->mm->sz = p->mm->sz;
+  for (i = 0; i < VMASIZE; i++)
+  {
+    if (p->mm->vma[i].valid)
+    {
+      np->mm->vma[i] = p->mm->vma[i];
+      filedup(p->mm->vma[i].f);
+    }
+  }
+  releasesleep(&p->mm->vmlock);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -307,11 +625,13 @@ int fork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  // increment reference counts on open file descriptors.
+  // a table of its own, with references to the same files.
+  acquire(&p->fdt->lock);
   for (i = 0; i < NOFILE; i++)
-    if (p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if (p->fdt->ofile[i])
+      np->fdt->ofile[i] = filedup(p->fdt->ofile[i]);
+  np->fdt->cwd = idup(p->fdt->cwd);
+  release(&p->fdt->lock);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -324,15 +644,56 @@ int fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
-  for (int i = 0; i < VMASIZE; i++)
+  // spread new processes over the CPUs.
+  push_off();
+  setrunnable(np, runq_shortest());
+  pop_off();
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread: a process that shares the caller's address
+// space and starts at fn(arg) on the user stack whose top is
+// stack. It shares the caller's open files and current
+// directory. fn must not return; it should call exit().
+// Returns the new thread's pid, which join() takes.
+int clone(uint64 fn, uint64 stack, uint64 arg)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if ((np = allocproc(p->mm)) == 0)
   {
-    if (p->vma[i].valid)
-    {
-      memmove(&(np->vma[i]), &(p->vma[i]), sizeof(p->vma[i]));
-      filedup(p->vma[i].f);
-    }
+    return -1;
   }
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack & ~0xfUL; // riscv sp must be 16-byte aligned
+  np->trapframe->a0 = arg;
+  np->trapframe->ra = 0;
+
+  acquire(&p->fdt->lock);
+  p->fdt->ref++;
+  release(&p->fdt->lock);
+  np->fdt = p->fdt;
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  push_off();
+  setrunnable(np, runq_shortest());
+  pop_off();
   release(&np->lock);
 
   return pid;
@@ -364,34 +725,26 @@ void exit(int status)
   if (p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for (int fd = 0; fd < NOFILE; fd++)
-  {
-    if (p->ofile[fd])
-    {
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+  // the last thread out closes the files.
+  fdtput(p);
 
-  for (int i = 0; i < VMASIZE; i++)
+  // the last thread out unmaps the files.
+  acquire(&p->mm->lock);
+  int last = --p->mm->nlive == 0;
+  release(&p->mm->lock);
+  for (int i = 0; last && i < VMASIZE; i++)
   {
-    if (p->vma[i].valid)
+    struct vma *v = &p->mm->vma[i];
+    if (v->valid)
     {
-      if (p->vma[i].flags & MAP_SHARED)
-        filewrite(p->vma[i].f, p->vma[i].addr, p->vma[i].len);
-      fileclose(p->vma[i].f);
-      uvmunmap(p->pagetable, p->vma[i].addr, p->vma[i].len / PGSIZE, 1);
-      p->vma[i].valid = 0;
+      if (v->flags & MAP_SHARED)
+        filewrite(v->f, v->addr, v->len);
+      fileclose(v->f);
+      uvmunmap(p->pagetable, v->addr, v->len / PGSIZE, 1);
+      v->valid = 0;
     }
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
-
   acquire(&wait_lock);
 
   // Give any children to init.
@@ -428,7 +781,8 @@ int wait(uint64 addr)
     havekids = 0;
     for (np = proc; np < &proc[NPROC]; np++)
     {
-      if (np->parent == p)
+      // threads are collected by join().
+      if (np->parent == p && np->mm != p->mm)
       {
         // make sure the child isn't still in exit() or swtch().
         acquire(&np->lock);
@@ -466,6 +820,45 @@ int wait(uint64 addr)
   }
 }
 
+// Wait for thread tid, created by this process with clone(),
+// to exit, and free it. Returns tid, or -1 if there is no
+// such thread.
+int join(int tid)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+
+  for (;;)
+  {
+    for (np = proc; np < &proc[NPROC]; np++)
+    {
+      if (np->parent == p && np->mm == p->mm && np->pid == tid)
+        break;
+    }
+    if (np == &proc[NPROC] || p->killed)
+    {
+      release(&wait_lock);
+      return -1;
+    }
+
+    // make sure the thread isn't still in exit() or swtch().
+    acquire(&np->lock);
+    if (np->state == ZOMBIE)
+    {
+      freeproc(np);
+      release(&np->lock);
+      release(&wait_lock);
+      return tid;
+    }
+    release(&np->lock);
+
+    // Wait for a child to exit.
+    sleep(p, &wait_lock);
+  }
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -477,34 +870,59 @@ void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
 
   c->proc = 0;
+  runqs[id].online = 1;
   for (;;)
   {
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for (p = proc; p < &proc[NPROC]; p++)
+    if ((p = runq_next(id)) == 0)
     {
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+      idle();
+      continue;
     }
+
+    acquire(&p->lock);
+    if (p->state != RUNNABLE)
+      panic("scheduler: queued proc not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    c->proc = p;
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
+// Called by scheduler() when no run queue had anything
+// to run. Does one batch of deferred background work if there
+// is any; otherwise stops this CPU until the next interrupt
+// rather than spinning on the proc locks.
+// A wakeup() from another CPU does not interrupt this one, so
+// a newly runnable process may wait for the next timer tick.
+static void
+idle(void)
+{
+  // background work must not be done with interrupts off,
+  // and wfi only returns on an interrupt that can be taken.
+  intr_on();
+
+  // pre-zero free pages for kalloc_zeroed().
+  if (kzero_pages(KZEROBATCH) > 0)
+    return;
+
+  wfi();
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -536,7 +954,7 @@ void yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable_here(p);
   sched();
   release(&p->lock);
 }
@@ -567,49 +985,137 @@ void forkret(void)
 void sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = waitq_for(chan);
+  struct proc **pp;
 
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Must acquire the wait queue lock and p->lock in order
+  // to join the queue, change p->state and then call sched.
+  // Once we hold the wait queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks it),
   // so it's okay to release lk.
 
-  acquire(&p->lock); // DOC: sleeplock1
+  acquire(&wq->lock); // DOC: sleeplock1
+  acquire(&p->lock);
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = wq->head;
+  wq->head = p;
+  release(&wq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  acquire(&wq->lock);
+  for (pp = &wq->head; *pp != p; pp = &(*pp)->wqnext)
+    ;
+  *pp = p->wqnext;
+  p->wqnext = 0;
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
-// Wake up all processes sleeping on chan.
+// Wake up at most n processes sleeping on chan,
+// or all of them if n is negative.
+// Returns the number woken.
 // Must be called without any p->lock.
-void wakeup(void *chan)
+int wakeupn(void *chan, int n)
 {
+  struct waitq *wq = waitq_for(chan);
   struct proc *p;
+  int woken = 0;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&wq->lock);
+  for (p = wq->head; p != 0 && woken != n; p = p->wqnext)
   {
     if (p != myproc())
     {
       acquire(&p->lock);
       if (p->state == SLEEPING && p->chan == chan)
       {
-        p->state = RUNNABLE;
+        // queue on this CPU, which is known to be awake;
+        // idle CPUs steal from it.
+        setrunnable_here(p);
+        woken++;
       }
       release(&p->lock);
     }
   }
+  release(&wq->lock);
+  return woken;
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void wakeup(void *chan)
+{
+  wakeupn(chan, -1);
+}
+
+// The physical address of the 4-byte-aligned futex word
+// at user address va, or 0 if there is none.
+static uint64
+futexaddr(uint64 va)
+{
+  uint64 pa;
+
+  if (va % 4 != 0 || (pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(va))) == 0)
+    return 0;
+  return pa + va % PGSIZE;
+}
+
+static struct spinlock *
+futexlock(uint64 pa)
+{
+  return &futexlocks[(pa >> 2) % NFUTEX];
+}
+
+// Sleep until a futex_wake() on the word at user address va,
+// if the word still holds val. Keyed by physical address, so
+// threads sharing the memory meet on the same word.
+// Returns 0 after sleeping, -1 if the word held another value.
+int futexwait(uint64 va, int val)
+{
+  struct spinlock *lk;
+  uint64 pa;
+  int r = -1;
+
+  if ((pa = futexaddr(va)) == 0)
+    return -1;
+  lk = futexlock(pa);
+  acquire(lk);
+  if (*(int *)pa == val && !myproc()->killed)
+  {
+    sleep((void *)pa, lk);
+    r = 0;
+  }
+  release(lk);
+  return r;
+}
+
+// Wake up to n processes waiting on the word at user address va.
+// Returns the number woken.
+int futexwake(uint64 va, int n)
+{
+  struct spinlock *lk;
+  uint64 pa;
+  int r;
+
+  if ((pa = futexaddr(va)) == 0 || n < 0)
+    return -1;
+  lk = futexlock(pa);
+  acquire(lk);
+  r = wakeupn((void *)pa, n);
+  release(lk);
+  return r;
 }
 
 // Kill the process with the given pid.
@@ -628,7 +1134,7 @@ int kill(int pid)
       if (p->state == SLEEPING)
       {
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable_here(p);
       }
       release(&p->lock);
       return 0;
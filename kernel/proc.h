@@ -93,18 +93,14 @@ enum procstate
   ZOMBIE
 };
 
-#define VMASIZE 16
-struct
-    vma
+// Open files and current directory. Every thread of a
+// process shares one, as it shares the process's struct mm.
+struct fdtable
 {
-  int valid;
-  uint64 addr;
-  int len;
-  struct file *f;
-  int prot;
-  int flags;
-  int fd;
-  int offset;
+  struct spinlock lock;       // protects ref, ofile and cwd
+  int ref;                    // Number of procs using this table
+  struct file *ofile[NOFILE]; // Open files
+  struct inode *cwd;          // Current directory
 };
 
 // Per-process state
@@ -122,14 +118,21 @@ struct proc
   // wait_lock must be held when using this:
   struct proc *parent; // Parent process
 
+  // the lock of the run queue p is on must be held when using this:
+  struct proc *rqnext; // Next process on the same run queue
+
+  // the lock of the wait queue for p->chan must be held when using this:
+  struct proc *wqnext; // Next process on the same wait queue
+
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  struct mm *mm;               // Address space, shared with threads
+  pagetable_t pagetable;       // User page table, same as mm->pagetable
+  int tfslot;                  // trapframe is mapped at TRAPFRAMEAT(tfslot)
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct fdtable *fdt;         // Open files, shared with threads
+  struct file *held[2];        // Files argfd() holds for this syscall
+  int logres;                  // Log blocks reserved by begin_op()
   char name[16];               // Process name (debugging)
-  struct vma vma[VMASIZE];
 };
@@ -331,6 +331,13 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// stall the hart until an interrupt is pending.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
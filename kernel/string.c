@@ -4,7 +4,17 @@ void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
+  uint64 *wdst, w;
   int i;
+
+  // fast path for whole aligned words, e.g. zeroing a page.
+  if(((uint64)dst % sizeof(uint64)) == 0 && (n % sizeof(uint64)) == 0){
+    w = (uchar)c * 0x0101010101010101ULL;
+    wdst = (uint64 *) dst;
+    for(i = 0; i < n / sizeof(uint64); i++)
+      wdst[i] = w;
+    return dst;
+  }
   for(i = 0; i < n; i++){
     cdst[i] = c;
   }
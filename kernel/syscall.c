@@ -3,7 +3,9 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "mm.h"
 #include "syscall.h"
 #include "defs.h"
 
@@ -11,7 +13,7 @@
 int fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if (addr >= p->sz || addr + sizeof(uint64) > p->sz)
+  if (addr >= p->mm->sz || addr + sizeof(uint64) > p->mm->sz)
     return -1;
   if (copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -102,6 +104,20 @@ extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 extern uint64 sys_mmap(void);
 extern uint64 sys_munmap(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_copy_file_range(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_logstat(void);
 
 static uint64 (*syscalls[])(void) = {
     [SYS_fork] sys_fork,
@@ -127,6 +143,20 @@ static uint64 (*syscalls[])(void) = {
     [SYS_close] sys_close,
     [SYS_mmap] sys_mmap,
     [SYS_munmap] sys_munmap,
+    [SYS_splice] sys_splice,
+    [SYS_copy_file_range] sys_copy_file_range,
+    [SYS_readv] sys_readv,
+    [SYS_writev] sys_writev,
+    [SYS_pread] sys_pread,
+    [SYS_pwrite] sys_pwrite,
+    [SYS_lseek] sys_lseek,
+    [SYS_fcntl] sys_fcntl,
+    [SYS_poll] sys_poll,
+    [SYS_clone] sys_clone,
+    [SYS_join] sys_join,
+    [SYS_futex_wait] sys_futex_wait,
+    [SYS_futex_wake] sys_futex_wake,
+    [SYS_logstat] sys_logstat,
 };
 
 void syscall(void)
@@ -138,6 +168,7 @@ void syscall(void)
   if (num > 0 && num < NELEM(syscalls) && syscalls[num])
   {
     p->trapframe->a0 = syscalls[num]();
+    fdrelease();
   }
   else
   {
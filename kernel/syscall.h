@@ -22,3 +22,17 @@
 #define SYS_close 21
 #define SYS_mmap 22
 #define SYS_munmap 23
+#define SYS_splice 24
+#define SYS_copy_file_range 25
+#define SYS_readv 26
+#define SYS_writev 27
+#define SYS_pread 28
+#define SYS_pwrite 29
+#define SYS_lseek 30
+#define SYS_fcntl 31
+#define SYS_poll 32
+#define SYS_clone 33
+#define SYS_join 34
+#define SYS_futex_wait 35
+#define SYS_futex_wake 36
+#define SYS_logstat 37
@@ -13,21 +13,45 @@
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
+#include "mm.h"
 #include "file.h"
 #include "fcntl.h"
+#include "iovec.h"
+#include "poll.h"
+#include "logstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// If other threads share the descriptor table, one of them may
+// close fd while this call is using the file, so hold a reference
+// to it until the call returns (see fdrelease()).
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
-  int fd;
+  int fd, i;
   struct file *f;
+  struct proc *p = myproc();
+  struct fdtable *fdt = p->fdt;
 
   if (argint(n, &fd) < 0)
     return -1;
-  if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0)
+  if (fd < 0 || fd >= NOFILE)
     return -1;
+  acquire(&fdt->lock);
+  if ((f = fdt->ofile[fd]) == 0)
+  {
+    release(&fdt->lock);
+    return -1;
+  }
+  if (fdt->ref > 1)
+  {
+    for (i = 0; i < NELEM(p->held) && p->held[i]; i++)
+      ;
+    if (i == NELEM(p->held))
+      panic("argfd: held");
+    p->held[i] = filedup(f);
+  }
+  release(&fdt->lock);
   if (pfd)
     *pfd = fd;
   if (pf)
@@ -35,25 +59,79 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
+// Drop the references argfd() took for this system call.
+void
+fdrelease(void)
+{
+  struct proc *p = myproc();
+  int i;
+
+  for (i = 0; i < NELEM(p->held); i++)
+  {
+    if (p->held[i])
+    {
+      fileclose(p->held[i]);
+      p->held[i] = 0;
+    }
+  }
+}
+
+// Return the file open as fd, with a reference the caller
+// must drop with fileclose(), or 0 if fd is not open.
+static struct file *
+fdget(int fd)
+{
+  struct fdtable *fdt = myproc()->fdt;
+  struct file *f;
+
+  if (fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&fdt->lock);
+  if ((f = fdt->ofile[fd]) != 0)
+    filedup(f);
+  release(&fdt->lock);
+  return f;
+}
+
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
 static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct fdtable *fdt = myproc()->fdt;
 
+  acquire(&fdt->lock);
   for (fd = 0; fd < NOFILE; fd++)
   {
-    if (p->ofile[fd] == 0)
+    if (fdt->ofile[fd] == 0)
     {
-      p->ofile[fd] = f;
+      fdt->ofile[fd] = f;
+      release(&fdt->lock);
       return fd;
     }
   }
+  release(&fdt->lock);
   return -1;
 }
 
+// Take fd out of the table. Returns the file it held,
+// whose reference passes to the caller, or 0.
+static struct file *
+fdfree(int fd)
+{
+  struct fdtable *fdt = myproc()->fdt;
+  struct file *f;
+
+  if (fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&fdt->lock);
+  f = fdt->ofile[fd];
+  fdt->ofile[fd] = 0;
+  release(&fdt->lock);
+  return f;
+}
+
 uint64
 sys_dup(void)
 {
@@ -93,15 +171,211 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Read or write at an explicit offset,
+// without moving the file's own offset.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+      argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+      argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if (argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
+// Get or set a file's flags. Only O_NONBLOCK can be changed.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, flags;
+
+  if (argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch (cmd)
+  {
+  case F_GETFL:
+    flags = f->readable && f->writable ? O_RDWR : f->writable ? O_WRONLY : O_RDONLY;
+    if (f->nonblock)
+      flags |= O_NONBLOCK;
+    return flags;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+// Wait until one of n files is ready, or timeout ticks pass.
+// A negative timeout waits for ever.
+// Returns the number of fds with events to report.
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NOFILE];
+  struct proc *p = myproc();
+  struct file *f;
+  uint64 ufds;
+  int n, timeout, i, ready;
+  uint seq, t0;
+
+  if (argaddr(0, &ufds) < 0 || argint(1, &n) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if (n < 0 || n > NOFILE)
+    return -1;
+  if (copyin(p->pagetable, (char *)fds, ufds, n * sizeof(fds[0])) < 0)
+    return -1;
+
+  acquire(&tickslock);
+  t0 = ticks;
+  release(&tickslock);
+  seq = pollstart();
+  for (;;)
+  {
+    ready = 0;
+    for (i = 0; i < n; i++)
+    {
+      fds[i].revents = 0;
+      if (fds[i].fd < 0)
+        continue;
+      if ((f = fdget(fds[i].fd)) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+      {
+        fds[i].revents = filepoll(f, fds[i].events);
+        fileclose(f);
+      }
+      if (fds[i].revents)
+        ready++;
+    }
+    if (ready || timeout == 0 || p->killed)
+      break;
+    if (timeout > 0 && ticks - t0 >= timeout)
+      break;
+    seq = pollsleep(seq);
+  }
+  pollend();
+
+  if (p->killed)
+    return -1;
+  if (copyout(p->pagetable, ufds, (char *)fds, n * sizeof(fds[0])) < 0)
+    return -1;
+  return ready;
+}
+
+// Move up to n bytes between a file and a pipe
+// without copying them through user memory.
+uint64
+sys_splice(void)
+{
+  struct file *fin, *fout;
+  int n;
+
+  if (argfd(0, 0, &fin) < 0 || argfd(1, 0, &fout) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(fin, fout, n);
+}
+
+// Copy up to n bytes from one file to another
+// inside the kernel.
+uint64
+sys_copy_file_range(void)
+{
+  struct file *fin, *fout;
+  int n;
+
+  if (argfd(0, 0, &fin) < 0 || argfd(1, 0, &fout) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filecopy(fin, fout, n);
+}
+
+// Fetch the iovec array and its length from system call
+// arguments n and n+1 into iov[IOV_MAX]. The lengths must
+// add up to no more than fits in an int, like Linux's EINVAL.
+// Returns the number of iovecs, or -1.
+static int
+argiov(int n, struct iovec *iov)
+{
+  uint64 uiov, tot;
+  int niov, i;
+
+  if (argaddr(n, &uiov) < 0 || argint(n + 1, &niov) < 0)
+    return -1;
+  if (niov < 0 || niov > IOV_MAX)
+    return -1;
+  if (copyin(myproc()->pagetable, (char *)iov, uiov, niov * sizeof(iov[0])) < 0)
+    return -1;
+  tot = 0;
+  for (i = 0; i < niov; i++)
+  {
+    if (iov[i].iov_len > 0x7fffffff)
+      return -1;
+    tot += iov[i].iov_len;
+  }
+  if (tot > 0x7fffffff)
+    return -1;
+  return niov;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int niov;
+
+  if (argfd(0, 0, &f) < 0 || (niov = argiov(1, iov)) < 0)
+    return -1;
+  return filereadv(f, iov, niov);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int niov;
+
+  if (argfd(0, 0, &f) < 0 || (niov = argiov(1, iov)) < 0)
+    return -1;
+  return filewritev(f, iov, niov);
+}
+
 uint64
 sys_close(void)
 {
   int fd;
   struct file *f;
 
-  if (argfd(0, &fd, &f) < 0)
+  if (argint(0, &fd) < 0 || (f = fdfree(fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -117,6 +391,21 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Copy the file system log statistics to user space.
+uint64
+sys_logstat(void)
+{
+  struct logstat st;
+  uint64 addr; // user pointer to struct logstat
+
+  if (argaddr(0, &addr) < 0)
+    return -1;
+  log_stat(&st);
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 uint64
 sys_link(void)
@@ -191,7 +480,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -223,9 +511,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if (ip->type == T_DIR)
   {
     dp->nlink--;
@@ -325,7 +611,7 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if (ip->type == T_DIR && omode != O_RDONLY)
+    if (ip->type == T_DIR && (omode & ~O_NONBLOCK) != O_RDONLY)
     {
       iunlockput(ip);
       end_op();
@@ -362,6 +648,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if ((omode & O_TRUNC) && ip->type == T_FILE)
   {
@@ -416,7 +703,7 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
+  struct inode *ip, *old;
   struct proc *p = myproc();
 
   begin_op();
@@ -433,9 +720,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&p->fdt->lock);
+  old = p->fdt->cwd;
+  p->fdt->cwd = ip;
+  release(&p->fdt->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
@@ -502,7 +792,7 @@ sys_pipe(void)
   if ((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0)
   {
     if (fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdfree(fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -510,8 +800,8 @@ sys_pipe(void)
   if (copyout(p->pagetable, fdarray, (char *)&fd0, sizeof(fd0)) < 0 ||
       copyout(p->pagetable, fdarray + sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0)
   {
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdfree(fd0);
+    fdfree(fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -533,27 +823,33 @@ sys_mmap(void)
   if (!(f->writable) && (prot & PROT_WRITE) && flags == MAP_SHARED)
     return -1;
 
-  struct proc *p = myproc();
+  struct mm *mm = myproc()->mm;
   len = PGROUNDUP(len);
-  if (p->sz > MAXVA - len)
+  acquiresleep(&mm->vmlock);
+  if (mm->sz > MAXVA - len)
+  {
+    releasesleep(&mm->vmlock);
     return -1;
+  }
 
   for (int i = 0; i < VMASIZE; i++)
   {
-    if (p->vma[i].valid == 0)
+    if (mm->vma[i].valid == 0)
     {
-      p->vma[i].valid = 1;
-      p->vma[i].addr = p->sz;
-      p->vma[i].len = len;
-      p->vma[i].f = f;
-      p->vma[i].prot = prot;
-      p->vma[i].flags = flags;
-      p->vma[i].offset = offset;
+      mm->vma[i].valid = 1;
+      mm->vma[i].addr = mm->sz;
+      mm->vma[i].len = len;
+      mm->vma[i].f = f;
+      mm->vma[i].prot = prot;
+      mm->vma[i].flags = flags;
+      mm->vma[i].offset = offset;
       filedup(f);
-      p->sz += len;
-      return p->vma[i].addr;
+      mm->sz += len;
+      releasesleep(&mm->vmlock);
+      return mm->vma[i].addr;
     }
   }
+  releasesleep(&mm->vmlock);
   return -1;
 }
 
@@ -569,20 +865,19 @@ sys_munmap(void)
   len = PGROUNDUP(len);
 
   struct proc *p = myproc();
+  struct mm *mm = p->mm;
   struct vma *vma = 0;
+  acquiresleep(&mm->vmlock);
   for (int i = 0; i < VMASIZE; i++)
   {
-    if (addr >= p->vma[i].addr && addr < p->vma[i].addr + p->vma[i].len)
+    if (addr >= mm->vma[i].addr && addr < mm->vma[i].addr + mm->vma[i].len)
     {
-      vma = &p->vma[i];
+      vma = &mm->vma[i];
       break;
     }
   }
 
-  if (vma == 0)
-    return 0;
-
-  if (vma->addr == addr)
+  if (vma && vma->addr == addr)
   {
     vma->addr += len;
     vma->len -= len;
@@ -596,5 +891,6 @@ sys_munmap(void)
       vma->valid = 0;
     }
   }
+  releasesleep(&mm->vmlock);
   return 0;
 }
@@ -5,7 +5,9 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "mm.h"
 
 uint64
 sys_exit(void)
@@ -41,17 +43,63 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  int addr, r;
   int n;
+  struct mm *mm = myproc()->mm;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  acquiresleep(&mm->vmlock);
+  addr = mm->sz;
+  r = growproc(n);
+  releasesleep(&mm->vmlock);
+  if(r < 0)
     return -1;
   return addr;
 }
 
+uint64
+sys_clone(void)
+{
+  uint64 fn, stack, arg;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &stack) < 0 || argaddr(2, &arg) < 0)
+    return -1;
+  return clone(fn, stack, arg);
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  return join(tid);
+}
+
 uint64
 sys_sleep(void)
 {
@@ -7,6 +7,7 @@
 #include "defs.h"
 #include "fcntl.h"
 #include "sleeplock.h"
+#include "mm.h"
 #include "fs.h"
 #include "file.h"
 
@@ -76,29 +77,41 @@ void usertrap(void)
   {
     // page fault.
     uint64 va = r_stval();
-    if (va >= p->sz || va > MAXVA || PGROUNDUP(va) == PGROUNDDOWN(p->trapframe->sp))
+    struct mm *mm = p->mm;
+    acquiresleep(&mm->vmlock);
+    if (va >= mm->sz || va > MAXVA || PGROUNDUP(va) == PGROUNDDOWN(p->trapframe->sp))
       p->killed = 1;
     struct vma *vma = 0;
     for (int i = 0; i < VMASIZE; i++)
     {
-      if (p->vma[i].valid && va >= p->vma[i].addr && va < p->vma[i].addr + p->vma[i].len)
+      if (mm->vma[i].valid && va >= mm->vma[i].addr && va < mm->vma[i].addr + mm->vma[i].len)
       {
-        vma = &p->vma[i];
+        vma = &mm->vma[i];
         break;
       }
     }
+    pte_t *pte = 0;
     if (vma)
+      pte = walk(p->pagetable, PGROUNDDOWN(va), 0);
+    if (pte && (*pte & PTE_V))
+    {
+      // another thread may have faulted the page in already;
+      // if the mapping does not allow this access, it is a
+      // real fault.
+      if ((*pte & (r_scause() == 15 ? PTE_W : PTE_R)) == 0)
+        p->killed = 1;
+    }
+    else if (vma)
     {
       va = PGROUNDDOWN(va);
       uint64 offset = va - vma->addr;
-      uint64 mem = (uint64)kalloc();
+      uint64 mem = (uint64)kalloc_zeroed();
       if (mem == 0)
       {
         p->killed = 1;
       }
       else
       {
-        memset((void *)mem, 0, PGSIZE);
         ilock(vma->f->ip);
         readi(vma->f->ip, 0, mem, offset, PGSIZE);
         iunlock(vma->f->ip);
@@ -116,6 +129,7 @@ void usertrap(void)
         }
       }
     }
+    releasesleep(&mm->vmlock);
   }
   else
   {
@@ -175,7 +189,7 @@ void usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64, uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64, uint64))fn)(TRAPFRAMEAT(p->tfslot), satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -215,6 +229,7 @@ void clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  pollwakeup();  // for poll() timeouts
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -33,18 +33,28 @@
 #define LCR_BAUD_LATCH (1<<7) // special mode to set baud rate
 #define LSR 5                 // line status register
 #define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
-#define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
+#define LSR_TX_IDLE (1<<5)    // THR and the transmit FIFO are empty
+#define FIFO_SIZE 16          // bytes the transmit FIFO holds
 
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
 // the transmit output buffer.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 1024
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
 
+// bytes uartputc_sync() may still put in the transmit
+// FIFO before it must wait for the FIFO to drain.
+// uartstart() fills the FIFO and clears this.
+// uart_fifo_lock protects uart_tx_room and writes to THR,
+// which come from uartstart() and uartputc_sync() alike;
+// it is taken after uart_tx_lock.
+struct spinlock uart_fifo_lock;
+int uart_tx_room;
+
 extern volatile int panicked; // from printf.c
 
 void uartstart();
@@ -75,17 +85,21 @@ uartinit(void)
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 
   initlock(&uart_tx_lock, "uart");
+  initlock(&uart_fifo_lock, "uartfifo");
 }
 
-// add a character to the output buffer and tell the
-// UART to start sending if it isn't already.
-// blocks if the output buffer is full.
+// copy n bytes from src (a user address if user_src is set)
+// to the output buffer and tell the UART to start sending
+// if it isn't already. copies as much as fits at a time,
+// and blocks while the output buffer is full.
 // because it may block, it can't be called
 // from interrupts; it's only suitable for use
-// by write().
-void
-uartputc(int c)
+// by write(). returns the number of bytes copied.
+int
+uartwrite(int user_src, uint64 src, int n)
 {
+  int i, m;
+
   acquire(&uart_tx_lock);
 
   if(panicked){
@@ -93,19 +107,28 @@ uartputc(int c)
       ;
   }
 
-  while(1){
+  for(i = 0; i < n; i += m){
     if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
       // buffer is full.
       // wait for uartstart() to open up space in the buffer.
       sleep(&uart_tx_r, &uart_tx_lock);
-    } else {
-      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
-      uart_tx_w += 1;
-      uartstart();
-      release(&uart_tx_lock);
-      return;
+      m = 0;
+      continue;
     }
+    // the free run up to the end of the buffer or to uart_tx_r.
+    m = UART_TX_BUF_SIZE - uart_tx_w % UART_TX_BUF_SIZE;
+    if(m > UART_TX_BUF_SIZE - (uart_tx_w - uart_tx_r))
+      m = UART_TX_BUF_SIZE - (uart_tx_w - uart_tx_r);
+    if(m > n - i)
+      m = n - i;
+    if(either_copyin(&uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE], user_src, src + i, m) == -1)
+      break;
+    uart_tx_w += m;
+    uartstart();
   }
+
+  release(&uart_tx_lock);
+  return i;
 }
 
 // alternate version of uartputc() that doesn't 
@@ -115,49 +138,55 @@ uartputc(int c)
 void
 uartputc_sync(int c)
 {
-  push_off();
-
   if(panicked){
     for(;;)
       ;
   }
 
-  // wait for Transmit Holding Empty to be set in LSR.
-  while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
-    ;
+  acquire(&uart_fifo_lock);
+  if(uart_tx_room == 0){
+    // wait for the transmit FIFO to drain.
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    uart_tx_room = FIFO_SIZE;
+  }
+  uart_tx_room--;
   WriteReg(THR, c);
-
-  pop_off();
+  release(&uart_fifo_lock);
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// if the UART is idle, and characters are waiting
+// in the transmit buffer, send up to a FIFO's worth.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void
 uartstart()
 {
-  while(1){
-    if(uart_tx_w == uart_tx_r){
-      // transmit buffer is empty.
-      return;
-    }
-    
-    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
-      // the UART transmit holding register is full,
-      // so we cannot give it another byte.
-      // it will interrupt when it's ready for a new byte.
-      return;
-    }
-    
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
+  int i;
+
+  if(uart_tx_w == uart_tx_r){
+    // transmit buffer is empty.
+    return;
+  }
+
+  acquire(&uart_fifo_lock);
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+    // the UART is still sending the last batch,
+    // so we cannot give it more bytes.
+    // it will interrupt when the FIFO is empty.
+    release(&uart_fifo_lock);
+    return;
+  }
+
+  for(i = 0; i < FIFO_SIZE && uart_tx_w != uart_tx_r; i++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
     uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
   }
+  uart_tx_room = 0;
+  release(&uart_fifo_lock);
+
+  // maybe uartwrite() is waiting for space in the buffer.
+  wakeup(&uart_tx_r);
 }
 
 // read one input character from the UART.
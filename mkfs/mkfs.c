@@ -40,6 +40,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void dirindex(uint inum);
 void die(const char *);
 
 // convert to intel byte order
@@ -84,6 +85,7 @@ main(int argc, char *argv[])
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
+  assert(sizeof(struct dhblock) == BSIZE);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0)
@@ -167,6 +169,11 @@ main(int argc, char *argv[])
   din.size = xint(off);
   winode(rootino, &din);
 
+  // index the root directory if it is already big enough
+  // that the kernel would have.
+  if(off / sizeof(de) >= DIRHASHMIN)
+    dirindex(rootino);
+
   balloc(freeblock);
 
   exit(0);
@@ -249,6 +256,48 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the block holding block fbn of the file din,
+// allocating it and any index blocks on the way.
+uint
+fbnaddr(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint addr, n, i;
+  int level;
+
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0){
+      din->addrs[fbn] = xint(freeblock++);
+    }
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+
+  n = NINDIRECT;
+  for(level = 1; fbn >= n; level++){
+    fbn -= n;
+    n *= NINDIRECT;
+  }
+  assert(level <= NLEVELS);
+
+  if(xint(din->addrs[NDIRECT+level-1]) == 0){
+    din->addrs[NDIRECT+level-1] = xint(freeblock++);
+  }
+  addr = xint(din->addrs[NDIRECT+level-1]);
+  for(; level > 0; level--){
+    n /= NINDIRECT;
+    rsect(addr, (char*)indirect);
+    i = fbn / n;
+    fbn %= n;
+    if(indirect[i] == 0){
+      indirect[i] = xint(freeblock++);
+      wsect(addr, (char*)indirect);
+    }
+    addr = xint(indirect[i]);
+  }
+  return addr;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -256,7 +305,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -265,22 +313,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = fbnaddr(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -293,6 +326,68 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+// FNV-1a; must match dirhash() in kernel/fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Build the hash index of directory inum from its dirents.
+void
+dirindex(uint inum)
+{
+  struct dinode din;
+  struct dirent de;
+  struct dhhead hd;
+  struct dhblock blk;
+  char buf[BSIZE];
+  uint nslot, slot, h, bn, x;
+  int i;
+
+  rinode(inum, &din);
+  nslot = xint(din.size) / sizeof(de);
+  hd.nindexed = xint(nslot);
+  hd.noverflow = 0;
+  for(slot = 0; slot < nslot; slot++){
+    rsect(fbnaddr(&din, slot * sizeof(de) / BSIZE), buf);
+    memmove(&de, buf + slot * sizeof(de) % BSIZE, sizeof(de));
+    if(xshort(de.inum) == 0)
+      continue;
+    h = dirhash(de.name);
+    for(bn = 1 + h % NDHBUCKET; ; bn = NDHBUCKET + xint(blk.next)){
+      x = fbnaddr(&din, DIRHASHBLK + bn);
+      rsect(x, (char*)&blk);
+      for(i = 0; i < NDHENT && blk.ent[i].slot != 0; i++)
+        ;
+      if(i < NDHENT){
+        blk.ent[i].hash = xint(h);
+        blk.ent[i].slot = xint(slot + 1);
+        wsect(x, (char*)&blk);
+        break;
+      }
+      if(blk.next == 0){
+        hd.noverflow = xint(xint(hd.noverflow) + 1);
+        blk.next = hd.noverflow;
+        wsect(x, (char*)&blk);
+      }
+    }
+  }
+
+  bzero(buf, sizeof(buf));
+  memmove(buf, &hd, sizeof(hd));
+  wsect(fbnaddr(&din, DIRHASHBLK), buf);
+  winode(inum, &din);
+}
+
 void
 die(const char *s)
 {
@@ -9,6 +9,15 @@ cat(int fd)
 {
   int n;
 
+  // if one side is a file and the other a pipe, as in
+  // "cat file | grep x", let the kernel move the data.
+  while((n = splice(fd, 1, 64*1024)) > 0)
+    ;
+  if(n == 0)
+    return;
+
+  // otherwise (e.g. the console) copy through buf,
+  // starting wherever splice() left off.
   while((n = read(fd, buf, sizeof(buf))) > 0) {
     if (write(1, buf, n) != n) {
       fprintf(2, "cat: write error\n");
@@ -0,0 +1,147 @@
+// Threads that share the process's memory, on top of the
+// clone() and join() system calls, and mutexes and condition
+// variables for them, on top of futex_wait() and futex_wake().
+//
+// Each thread runs on a stack from malloc(). Since malloc()
+// is not thread-safe, create and join threads from a single
+// thread.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define STACKSIZE 16384
+
+// Placed at the top of a new thread's stack.
+struct start {
+  void (*fn)(void *);
+  void *arg;
+};
+
+static struct {
+  int tid;
+  char *stack;
+} threads[NTHREAD];
+
+static void
+threadstart(void *a)
+{
+  struct start *s = a;
+
+  s->fn(s->arg);
+  // exit() would flush the stdio buffers that the other
+  // threads are still using.
+  _exit(0);
+}
+
+// Start fn(arg) in a new thread. Returns its thread id.
+int
+kthread_create(void (*fn)(void *), void *arg)
+{
+  struct start *s;
+  char *stack;
+  int i, tid;
+
+  for(i = 0; i < NTHREAD; i++)
+    if(threads[i].stack == 0)
+      break;
+  if(i == NTHREAD || (stack = malloc(STACKSIZE)) == 0)
+    return -1;
+  s = (struct start*)(stack + STACKSIZE) - 1;
+  s->fn = fn;
+  s->arg = arg;
+  if((tid = clone(threadstart, s, s)) < 0){
+    free(stack);
+    return -1;
+  }
+  threads[i].tid = tid;
+  threads[i].stack = stack;
+  return tid;
+}
+
+// Wait for thread tid to finish and free its stack.
+int
+kthread_join(int tid)
+{
+  int i;
+
+  if(join(tid) < 0)
+    return -1;
+  for(i = 0; i < NTHREAD; i++){
+    if(threads[i].stack && threads[i].tid == tid){
+      free(threads[i].stack);
+      threads[i].stack = 0;
+    }
+  }
+  return tid;
+}
+
+// A mutex is 0 when unlocked, 1 when locked, and 2 when
+// locked with threads (perhaps) waiting in futex_wait().
+// Locking and unlocking without contention make no system
+// calls.
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // mark the mutex contended, then sleep until it is free.
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex_wake(&m->state, 1);
+  }
+}
+
+// A condition variable counts signals; a waiter sleeps
+// until the count moves on from what it saw before
+// releasing the mutex.
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, NPROC);
+}
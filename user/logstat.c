@@ -0,0 +1,40 @@
+// Print the file system log statistics.
+//
+// usage: logstat
+//
+// The counts are since boot; run it before and after a
+// workload to see how many blocks that workload logged,
+// how many log writes were absorbed and how long commits took.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct logstat st;
+
+  if(argc > 1){
+    fprintf(2, "usage: logstat\n");
+    exit(1);
+  }
+  if(logstat(&st) < 0){
+    fprintf(2, "logstat: failed\n");
+    exit(1);
+  }
+
+  printf("operations\t%l\n", st.ops);
+  printf("waits\t\t%l\n", st.waits);
+  printf("commits\t\t%l\n", st.commits);
+  printf("logged\t\t%l\n", st.logged);
+  printf("absorbed\t%l\n", st.absorbed);
+  printf("ordered\t\t%l\n", st.ordered);
+  printf("commit ticks\t%l\n", st.ticks);
+  printf("largest\t\t%d of %d blocks\n", st.maxlogged, st.size);
+  if(st.commits > 0)
+    printf("per commit\t%l blocks, %l ticks\n",
+           st.logged / st.commits, st.ticks / st.commits);
+  exit(0);
+}
@@ -0,0 +1,173 @@
+// Compare the word-at-a-time memory and string routines
+// in ulib.c with the byte-at-a-time loops they replaced.
+//
+// usage: membench [mbytes]
+//
+// For each buffer size from 4 KB to 1 MB, runs every routine
+// over mbytes (default 16) megabytes of data and prints the
+// elapsed clock ticks for the old and the new version.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MINSZ  (4*1024)
+#define MAXSZ  (1024*1024)
+
+// The original ulib.c implementations.
+
+static void*
+old_memset(void *dst, int c, uint n)
+{
+  char *cdst = (char *) dst;
+  int i;
+  for(i = 0; i < n; i++){
+    cdst[i] = c;
+  }
+  return dst;
+}
+
+static void*
+old_memmove(void *vdst, const void *vsrc, int n)
+{
+  char *dst;
+  const char *src;
+
+  dst = vdst;
+  src = vsrc;
+  if (src > dst) {
+    while(n-- > 0)
+      *dst++ = *src++;
+  } else {
+    dst += n;
+    src += n;
+    while(n-- > 0)
+      *--dst = *--src;
+  }
+  return vdst;
+}
+
+static int
+old_memcmp(const void *s1, const void *s2, uint n)
+{
+  const char *p1 = s1, *p2 = s2;
+  while (n-- > 0) {
+    if (*p1 != *p2) {
+      return *p1 - *p2;
+    }
+    p1++;
+    p2++;
+  }
+  return 0;
+}
+
+static uint
+old_strlen(const char *s)
+{
+  int n;
+
+  for(n = 0; s[n]; n++)
+    ;
+  return n;
+}
+
+static int
+old_strcmp(const char *p, const char *q)
+{
+  while(*p && *p == *q)
+    p++, q++;
+  return (uchar)*p - (uchar)*q;
+}
+
+char *a, *b;
+int sink;
+
+enum { MEMSET, MEMCPY, MEMCPY_UNALIGNED, MEMMOVE, MEMCMP, STRLEN, STRCMP, NOPS };
+
+static char *opnames[] = {
+  [MEMSET]            "memset",
+  [MEMCPY]            "memcpy",
+  [MEMCPY_UNALIGNED]  "memcpy+3",
+  [MEMMOVE]           "memmove",
+  [MEMCMP]            "memcmp",
+  [STRLEN]            "strlen",
+  [STRCMP]            "strcmp",
+};
+
+// Run op over a buffer of sz bytes, iters times.
+// Return the number of clock ticks taken.
+static int
+run(int op, int old, int sz, int iters)
+{
+  int i, t0;
+
+  // the string routines need a terminator at the end.
+  memset(a, 'x', sz);
+  memset(b, 'x', sz);
+  a[sz-1] = 0;
+  b[sz-1] = 0;
+
+  t0 = uptime();
+  for(i = 0; i < iters; i++){
+    switch(op){
+    case MEMSET:
+      if(old) old_memset(a, i, sz); else memset(a, i, sz);
+      break;
+    case MEMCPY:
+      if(old) old_memmove(a, b, sz); else memcpy(a, b, sz);
+      break;
+    case MEMCPY_UNALIGNED:
+      if(old) old_memmove(a, b+3, sz-3); else memcpy(a, b+3, sz-3);
+      break;
+    case MEMMOVE:
+      if(old) old_memmove(a+8, a, sz-8); else memmove(a+8, a, sz-8);
+      break;
+    case MEMCMP:
+      sink += old ? old_memcmp(a, b, sz) : memcmp(a, b, sz);
+      break;
+    case STRLEN:
+      sink += old ? old_strlen(a) : strlen(a);
+      break;
+    case STRCMP:
+      sink += old ? old_strcmp(a, b) : strcmp(a, b);
+      break;
+    }
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mbytes, sz, op, iters, told, tnew;
+
+  mbytes = 16;
+  if(argc > 1)
+    mbytes = atoi(argv[1]);
+  if(mbytes <= 0){
+    fprintf(2, "usage: membench [mbytes]\n");
+    exit(1);
+  }
+
+  a = malloc(MAXSZ);
+  b = malloc(MAXSZ);
+  if(a == 0 || b == 0){
+    fprintf(2, "membench: out of memory\n");
+    exit(1);
+  }
+
+  printf("membench: %d MB per test, times in ticks\n", mbytes);
+  printf("size\troutine\t\told\tnew\n");
+  for(sz = MINSZ; sz <= MAXSZ; sz *= 4){
+    iters = (mbytes * 1024 / (sz / 1024));
+    if(iters < 1)
+      iters = 1;
+    for(op = 0; op < NOPS; op++){
+      told = run(op, 1, sz, iters);
+      tnew = run(op, 0, sz, iters);
+      printf("%dK\t%s\t%s%d\t%d\n", sz / 1024, opnames[op],
+             strlen(opnames[op]) < 8 ? "\t" : "", told, tnew);
+    }
+  }
+  exit(0);
+}
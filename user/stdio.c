@@ -0,0 +1,335 @@
+// Buffered I/O streams.
+//
+// A FILE collects output in buf and hands it to write() a
+// buffer at a time. Streams on the console are line-buffered
+// and flushed at each newline; stderr is flushed at the end
+// of every call. Input is read ahead a buffer at a time.
+//
+// Output still buffered when the process calls exit(), fork()
+// or exec() is flushed first (see ulib.c), so that it is
+// neither lost nor written twice.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define F_READ    0x01  // opened for reading
+#define F_WRITE   0x02  // opened for writing
+#define F_LBF     0x04  // flush at each newline
+#define F_NBF     0x08  // flush at the end of each call
+#define F_MODE    0x10  // buffering mode has been decided
+#define F_EOF     0x20  // a read returned end of file
+#define F_ERR     0x40  // a read or write failed
+
+struct FILE {
+  int fd;
+  int flags;
+  int rpos;             // next byte of buf to hand out
+  int rcnt;             // bytes of buf read ahead
+  int wcnt;             // bytes of buf waiting to be written
+  struct FILE *next;    // on the list of open streams
+  char buf[BUFSIZ];
+};
+
+static FILE _stderr = { .fd = 2, .flags = F_WRITE|F_NBF|F_MODE };
+static FILE _stdout = { .fd = 1, .flags = F_WRITE, .next = &_stderr };
+static FILE _stdin  = { .fd = 0, .flags = F_READ, .next = &_stdout };
+
+FILE *stdin = &_stdin;
+FILE *stdout = &_stdout;
+FILE *stderr = &_stderr;
+
+static FILE *files = &_stdin;   // all open streams
+
+extern void (*stdio_flush)(void);
+
+static void
+flushall(void)
+{
+  fflush(0);
+}
+
+// Decide how to buffer output to f the first time it is used:
+// by line on a console, by the buffer otherwise.
+static void
+setmode(FILE *f)
+{
+  struct stat st;
+
+  if(f->flags & F_MODE)
+    return;
+  f->flags |= F_MODE;
+  if(fstat(f->fd, &st) == 0 && st.type == T_DEVICE)
+    f->flags |= F_LBF;
+}
+
+// Prepare f for reading: push out pending output.
+static int
+rmode(FILE *f)
+{
+  if((f->flags & F_READ) == 0)
+    return -1;
+  if(f->wcnt > 0 && fflush(f) < 0)
+    return -1;
+  return 0;
+}
+
+// Prepare f for writing: give back input read ahead.
+static int
+wmode(FILE *f)
+{
+  if((f->flags & F_WRITE) == 0)
+    return -1;
+  if(f->rpos < f->rcnt)
+    lseek(f->fd, f->rpos - f->rcnt, SEEK_CUR);
+  f->rpos = f->rcnt = 0;
+  setmode(f);
+  stdio_flush = flushall;
+  return 0;
+}
+
+// Read the next buffer of input into f.
+static int
+fill(FILE *f)
+{
+  int n;
+
+  // let a prompt on stdout appear before waiting for input.
+  if(f == stdin)
+    fflush(stdout);
+  f->rpos = f->rcnt = 0;
+  n = read(f->fd, f->buf, BUFSIZ);
+  if(n <= 0){
+    f->flags |= n == 0 ? F_EOF : F_ERR;
+    return -1;
+  }
+  f->rcnt = n;
+  return 0;
+}
+
+FILE*
+fopen(const char *path, const char *mode)
+{
+  FILE *f;
+  int fd, omode, flags;
+
+  switch(mode[0]){
+  case 'r':
+    omode = O_RDONLY;
+    flags = F_READ;
+    break;
+  case 'w':
+    omode = O_WRONLY|O_CREATE|O_TRUNC;
+    flags = F_WRITE;
+    break;
+  case 'a':
+    omode = O_WRONLY|O_CREATE;
+    flags = F_WRITE;
+    break;
+  default:
+    return 0;
+  }
+  if(mode[1] == '+'){
+    omode = (omode & ~O_WRONLY) | O_RDWR;
+    flags = F_READ|F_WRITE;
+  }
+
+  if((fd = open(path, omode)) < 0)
+    return 0;
+  if(mode[0] == 'a')
+    lseek(fd, 0, SEEK_END);
+  if((f = malloc(sizeof(*f))) == 0){
+    close(fd);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->fd = fd;
+  f->flags = flags;
+  f->next = files;
+  files = f;
+  return f;
+}
+
+int
+fclose(FILE *f)
+{
+  FILE **pp;
+  int r;
+
+  r = fflush(f);
+  if(close(f->fd) < 0)
+    r = -1;
+  for(pp = &files; *pp; pp = &(*pp)->next){
+    if(*pp == f){
+      *pp = f->next;
+      break;
+    }
+  }
+  if(f != stdin && f != stdout && f != stderr)
+    free(f);
+  return r;
+}
+
+// Write out f's buffered output, or that of every
+// open stream if f is 0.
+int
+fflush(FILE *f)
+{
+  int r;
+
+  if(f == 0){
+    r = 0;
+    for(f = files; f; f = f->next)
+      if(fflush(f) < 0)
+        r = -1;
+    return r;
+  }
+  if(f->wcnt == 0)
+    return 0;
+  r = write(f->fd, f->buf, f->wcnt);
+  if(r != f->wcnt){
+    f->flags |= F_ERR;
+    r = -1;
+  } else {
+    r = 0;
+  }
+  f->wcnt = 0;
+  return r;
+}
+
+uint
+fread(void *p, uint size, uint nmemb, FILE *f)
+{
+  char *dst = p;
+  uint want, got, m;
+  int n;
+
+  if(size == 0 || rmode(f) < 0)
+    return 0;
+  want = size * nmemb;
+  got = 0;
+  while(got < want){
+    if(f->rpos == f->rcnt){
+      if(want - got >= BUFSIZ){
+        // big reads go straight to the caller's buffer.
+        if((n = read(f->fd, dst + got, want - got)) <= 0){
+          f->flags |= n == 0 ? F_EOF : F_ERR;
+          break;
+        }
+        got += n;
+        continue;
+      }
+      if(fill(f) < 0)
+        break;
+    }
+    m = f->rcnt - f->rpos;
+    if(m > want - got)
+      m = want - got;
+    memmove(dst + got, f->buf + f->rpos, m);
+    f->rpos += m;
+    got += m;
+  }
+  return got / size;
+}
+
+uint
+fwrite(const void *p, uint size, uint nmemb, FILE *f)
+{
+  const char *src = p;
+  uint want, put, m, i;
+  int n, nl;
+
+  if(size == 0 || wmode(f) < 0)
+    return 0;
+  want = size * nmemb;
+  put = 0;
+  nl = 0;
+  while(put < want){
+    if(f->wcnt == 0 && want - put >= BUFSIZ){
+      // big writes skip the buffer.
+      if((n = write(f->fd, src + put, want - put)) > 0)
+        put += n;
+      if(put < want){
+        f->flags |= F_ERR;
+        break;
+      }
+      continue;
+    }
+    m = BUFSIZ - f->wcnt;
+    if(m > want - put)
+      m = want - put;
+    memmove(f->buf + f->wcnt, src + put, m);
+    if(f->flags & F_LBF)
+      for(i = 0; i < m && !nl; i++)
+        nl = src[put + i] == '\n';
+    f->wcnt += m;
+    put += m;
+    if(f->wcnt == BUFSIZ && fflush(f) < 0)
+      break;
+  }
+  if((f->flags & F_NBF) || nl)
+    fflush(f);
+  return put / size;
+}
+
+int
+fgetc(FILE *f)
+{
+  if(rmode(f) < 0)
+    return EOF;
+  if(f->rpos == f->rcnt && fill(f) < 0)
+    return EOF;
+  return (uchar)f->buf[f->rpos++];
+}
+
+int
+fputc(int c, FILE *f)
+{
+  if(wmode(f) < 0)
+    return EOF;
+  f->buf[f->wcnt++] = c;
+  if(f->wcnt == BUFSIZ || (f->flags & F_NBF) ||
+     (c == '\n' && (f->flags & F_LBF))){
+    if(fflush(f) < 0)
+      return EOF;
+  }
+  return (uchar)c;
+}
+
+// Read a line of at most max-1 bytes, keeping the newline.
+// Returns 0 if there was nothing left to read.
+char*
+fgets(char *buf, int max, FILE *f)
+{
+  int i, c;
+
+  for(i = 0; i+1 < max; ){
+    c = fgetc(f);
+    if(c < 0)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+  uint n = strlen(s);
+
+  return fwrite(s, 1, n, f) == n ? 0 : EOF;
+}
+
+// Bytes read ahead of the current line stay in stdin's
+// buffer and are not seen by exec()ed programs.
+char*
+gets(char *buf, int max)
+{
+  if(fgets(buf, max, stdin) == 0)
+    buf[0] = '\0';
+  return buf;
+}
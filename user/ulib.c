@@ -3,6 +3,14 @@
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
+// The memory and string routines below work a word at a
+// time where they can. WSIZE is the word size in bytes;
+// HASZERO(x) is non-zero iff some byte of x is zero.
+#define WSIZE  sizeof(uint64)
+#define ONES   0x0101010101010101ULL
+#define HIGHS  0x8080808080808080ULL
+#define HASZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -17,6 +25,23 @@ strcpy(char *s, const char *t)
 int
 strcmp(const char *p, const char *q)
 {
+  const uint64 *wp, *wq;
+
+  // When both strings share an alignment, compare a word
+  // at a time until the words differ or hold the terminator.
+  if(((uint64)p & (WSIZE-1)) == ((uint64)q & (WSIZE-1))){
+    while((uint64)p & (WSIZE-1)){
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+      p++, q++;
+    }
+    wp = (const uint64*)p;
+    wq = (const uint64*)q;
+    while(*wp == *wq && !HASZERO(*wp))
+      wp++, wq++;
+    p = (const char*)wp;
+    q = (const char*)wq;
+  }
   while(*p && *p == *q)
     p++, q++;
   return (uchar)*p - (uchar)*q;
@@ -25,21 +50,49 @@ strcmp(const char *p, const char *q)
 uint
 strlen(const char *s)
 {
-  int n;
+  const char *p;
+  const uint64 *w;
 
-  for(n = 0; s[n]; n++)
+  p = s;
+  while((uint64)p & (WSIZE-1)){
+    if(*p == 0)
+      return p - s;
+    p++;
+  }
+  // an aligned word never straddles a page, so reading
+  // past the terminator within it is harmless.
+  for(w = (const uint64*)p; !HASZERO(*w); w++)
     ;
-  return n;
+  for(p = (const char*)w; *p; p++)
+    ;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = (uchar*)dst;
+  uint64 *wd, w;
+
+  while(n > 0 && ((uint64)d & (WSIZE-1))){
+    *d++ = c;
+    n--;
+  }
+  if(n >= WSIZE){
+    w = (uchar)c * ONES;
+    wd = (uint64*)d;
+    for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4){
+      wd[0] = w;
+      wd[1] = w;
+      wd[2] = w;
+      wd[3] = w;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = w;
+    d = (uchar*)wd;
   }
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -52,24 +105,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -95,30 +130,117 @@ atoi(const char *s)
   return n;
 }
 
+// Copy n bytes from src to dst, lowest address first.
+// Aligns dst, then moves whole words; if src is not
+// aligned the same way, each stored word is spliced
+// from two aligned loads so no access is misaligned.
+static void
+copyfwd(uchar *dst, const uchar *src, uint n)
+{
+  uint64 *wd, lo, hi;
+  const uint64 *ws;
+  int off, rs, ls;
+
+  while(n > 0 && ((uint64)dst & (WSIZE-1))){
+    *dst++ = *src++;
+    n--;
+  }
+  if(n >= WSIZE){
+    wd = (uint64*)dst;
+    off = (uint64)src & (WSIZE-1);
+    if(off == 0){
+      ws = (const uint64*)src;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4, ws += 4){
+        wd[0] = ws[0];
+        wd[1] = ws[1];
+        wd[2] = ws[2];
+        wd[3] = ws[3];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *wd++ = *ws++;
+      src = (const uchar*)ws;
+    } else {
+      // little-endian: the low bytes of lo come first.
+      ws = (const uint64*)(src - off);
+      rs = off * 8;
+      ls = 64 - rs;
+      lo = *ws++;
+      for(; n >= WSIZE; n -= WSIZE, src += WSIZE){
+        hi = *ws++;
+        *wd++ = (lo >> rs) | (hi << ls);
+        lo = hi;
+      }
+    }
+    dst = (uchar*)wd;
+  }
+  while(n-- > 0)
+    *dst++ = *src++;
+}
+
+// Copy n bytes from src to dst, highest address first,
+// for overlapping moves to a higher address.
+static void
+copybwd(uchar *dst, const uchar *src, uint n)
+{
+  uint64 *wd;
+  const uint64 *ws;
+
+  dst += n;
+  src += n;
+  if((((uint64)dst ^ (uint64)src) & (WSIZE-1)) == 0){
+    while(n > 0 && ((uint64)dst & (WSIZE-1))){
+      *--dst = *--src;
+      n--;
+    }
+    wd = (uint64*)dst;
+    ws = (const uint64*)src;
+    for(; n >= WSIZE; n -= WSIZE)
+      *--wd = *--ws;
+    dst = (uchar*)wd;
+    src = (const uchar*)ws;
+  }
+  while(n-- > 0)
+    *--dst = *--src;
+}
+
 void*
 memmove(void *vdst, const void *vsrc, int n)
 {
-  char *dst;
-  const char *src;
+  uchar *dst;
+  const uchar *src;
 
+  if(n <= 0)
+    return vdst;
   dst = vdst;
   src = vsrc;
-  if (src > dst) {
-    while(n-- > 0)
-      *dst++ = *src++;
-  } else {
-    dst += n;
-    src += n;
-    while(n-- > 0)
-      *--dst = *--src;
-  }
+  if(src < dst && src + n > dst)
+    copybwd(dst, src, n);
+  else
+    copyfwd(dst, src, n);
   return vdst;
 }
 
 int
 memcmp(const void *s1, const void *s2, uint n)
 {
-  const char *p1 = s1, *p2 = s2;
+  const uchar *p1 = s1, *p2 = s2;
+  const uint64 *w1, *w2;
+
+  if((((uint64)p1 ^ (uint64)p2) & (WSIZE-1)) == 0){
+    while(n > 0 && ((uint64)p1 & (WSIZE-1))){
+      if(*p1 != *p2)
+        return *p1 - *p2;
+      p1++, p2++, n--;
+    }
+    // skip equal words; the byte loop below finds
+    // the first difference within a mismatching word.
+    w1 = (const uint64*)p1;
+    w2 = (const uint64*)p2;
+    for(; n >= WSIZE && *w1 == *w2; n -= WSIZE)
+      w1++, w2++;
+    p1 = (const uchar*)w1;
+    p2 = (const uchar*)w2;
+  }
   while (n-- > 0) {
     if (*p1 != *p2) {
       return *p1 - *p2;
@@ -132,5 +254,35 @@ memcmp(const void *s1, const void *s2, uint n)
 void *
 memcpy(void *dst, const void *src, uint n)
 {
-  return memmove(dst, src, n);
+  copyfwd(dst, src, n);
+  return dst;
+}
+
+// Set by stdio.c once a stream holds output, and called
+// before the process exits, forks or replaces itself so
+// that the output is written exactly once.
+void (*stdio_flush)(void);
+
+int
+fork(void)
+{
+  if(stdio_flush)
+    stdio_flush();
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(stdio_flush)
+    stdio_flush();
+  _exit(status);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(stdio_flush)
+    stdio_flush();
+  return _exec(path, argv);
 }
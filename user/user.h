@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct pollfd;
+struct logstat;
 
 // system calls
 int fork(void);
@@ -25,6 +28,23 @@ int sleep(int);
 int uptime(void);
 void *mmap(void *, int, int, int, int, uint);
 int munmap(void *, int);
+int splice(int, int, int);
+int copy_file_range(int, int, int);
+int readv(int, const struct iovec *, int);
+int writev(int, const struct iovec *, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int lseek(int, int, int);
+int fcntl(int, int, int);
+int poll(struct pollfd *, int, int);
+int clone(void (*)(void *), void *, void *);
+int join(int);
+int futex_wait(int *, int);
+int futex_wake(int *, int);
+int logstat(struct logstat*);
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
+int _exec(char *, char **);
 
 // ulib.c
 int stat(const char *, struct stat *);
@@ -42,3 +62,35 @@ void free(void *);
 int atoi(const char *);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// stdio.c
+#define BUFSIZ 512
+#define EOF (-1)
+typedef struct FILE FILE;
+extern FILE *stdin, *stdout, *stderr;
+FILE *fopen(const char *, const char *);
+int fclose(FILE *);
+uint fread(void *, uint, uint, FILE *);
+uint fwrite(const void *, uint, uint, FILE *);
+int fflush(FILE *);
+int fgetc(FILE *);
+int fputc(int, FILE *);
+char *fgets(char *, int, FILE *);
+int fputs(const char *, FILE *);
+
+// kthread.c
+struct mutex {
+  int state;
+};
+struct cond {
+  int seq;
+};
+int kthread_create(void (*)(void *), void *);
+int kthread_join(int);
+void mutex_init(struct mutex *);
+void mutex_lock(struct mutex *);
+void mutex_unlock(struct mutex *);
+void cond_init(struct cond *);
+void cond_wait(struct cond *, struct mutex *);
+void cond_signal(struct cond *);
+void cond_broadcast(struct cond *);
@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/iovec.h"
+#include "kernel/poll.h"
+#include "kernel/logstat.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -569,9 +572,13 @@ writetest(char *s)
   }
 }
 
+// write a file that reaches into the doubly-indirect blocks,
+// past the first block of pointers there. MAXFILE itself is
+// far bigger than the disk.
 void
 writebig(char *s)
 {
+  enum { NBIG = NDIRECT + NINDIRECT + NINDIRECT + 1 };
   int i, fd, n;
 
   fd = open("big", O_CREATE|O_RDWR);
@@ -580,7 +587,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -600,7 +607,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -779,6 +786,903 @@ pipe1(char *s)
   }
 }
 
+// push a lot of data through a pipe whose reader starts late,
+// so that the pipe fills up, grows and wraps around.
+void
+pipebig(char *s)
+{
+  int fds[2], pid, xstatus;
+  int seq, i, n, total;
+  enum { N=80, SZ=3001 };
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  seq = 0;
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < N; n++){
+      for(i = 0; i < SZ; i++)
+        buf[i] = seq++;
+      if(write(fds[1], buf, SZ) != SZ){
+        printf("%s: write failed\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  sleep(2);
+  total = 0;
+  while((n = read(fds[0], buf, 997)) > 0){
+    for(i = 0; i < n; i++){
+      if((buf[i] & 0xff) != (seq++ & 0xff)){
+        printf("%s: wrong data at %d\n", s, total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  if(total != N * SZ){
+    printf("%s: total %d, expected %d\n", s, total, N * SZ);
+    exit(1);
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+// splice() from a file into a pipe and from a pipe into a file.
+void
+splicetest(char *s)
+{
+  int fds[2], fd, i, n, total;
+  enum { SZ=5000 };
+
+  fd = open("splice.in", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fd = open("splice.in", O_RDONLY);
+  if((n = splice(fd, fds[1], 2*SZ)) != SZ){
+    printf("%s: splice file->pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if(splice(fd, fds[0], 1) >= 0 || splice(fd, fd, 1) >= 0){
+    printf("%s: bad splice succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("splice.out", O_CREATE|O_RDWR);
+  total = 0;
+  while(total < SZ){
+    if((n = splice(fds[0], fd, SZ - total)) <= 0){
+      printf("%s: splice pipe->file returned %d\n", s, n);
+      exit(1);
+    }
+    total += n;
+  }
+  close(fd);
+  close(fds[0]);
+  close(fds[1]);
+
+  memset(buf, 0, SZ);
+  fd = open("splice.out", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != SZ){
+    printf("%s: splice.out has wrong size\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < SZ; i++){
+    if((buf[i] & 0xff) != i % 251){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  unlink("splice.in");
+  unlink("splice.out");
+}
+
+// copy a multi-transaction file with copy_file_range().
+void
+copyrange(char *s)
+{
+  int fd0, fd1, i, n, total;
+  enum { SZ=10*1024+123 };
+
+  fd0 = open("copy.in", O_CREATE|O_RDWR);
+  if(fd0 < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 253;
+  if(write(fd0, buf, SZ) != SZ){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd0);
+
+  fd0 = open("copy.in", O_RDONLY);
+  fd1 = open("copy.out", O_CREATE|O_RDWR);
+  // start the destination at an unaligned offset.
+  if(write(fd1, "x", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  total = 0;
+  while((n = copy_file_range(fd0, fd1, 4000)) > 0)
+    total += n;
+  if(n < 0 || total != SZ){
+    printf("%s: copied %d of %d\n", s, total, SZ);
+    exit(1);
+  }
+  if(copy_file_range(fd0, fd0, 1) >= 0){
+    printf("%s: copy to self succeeded\n", s);
+    exit(1);
+  }
+  close(fd0);
+  close(fd1);
+
+  memset(buf, 0, SZ+1);
+  fd1 = open("copy.out", O_RDONLY);
+  if(read(fd1, buf, sizeof(buf)) != SZ+1 || buf[0] != 'x'){
+    printf("%s: copy.out has wrong size\n", s);
+    exit(1);
+  }
+  close(fd1);
+  for(i = 0; i < SZ; i++){
+    if((buf[i+1] & 0xff) != i % 253){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  unlink("copy.in");
+  unlink("copy.out");
+}
+
+// buffered streams: round trip through a file, and output
+// pending at fork() must be written once, not once per process.
+void
+stdiotest(char *s)
+{
+  FILE *f;
+  int i, fd, pid, xst;
+  char line[32];
+
+  if((f = fopen("stdio.out", "w")) == 0){
+    printf("%s: fopen failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*BUFSIZ; i++)
+    fputc('a' + i % 26, f);
+  if(fputs("\nlast\n", f) < 0 || fclose(f) < 0){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  f = fopen("stdio.out", "r");
+  memset(buf, 0, sizeof(buf));
+  if(fread(buf, 1, 2*BUFSIZ+1, f) != 2*BUFSIZ+1 ||
+     fgets(line, sizeof(line), f) == 0 || strcmp(line, "last\n") != 0 ||
+     fgetc(f) != EOF){
+    printf("%s: read back failed\n", s);
+    exit(1);
+  }
+  fclose(f);
+  for(i = 0; i < 2*BUFSIZ; i++){
+    if(buf[i] != 'a' + i % 26){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    if(open("stdio.out", O_CREATE|O_TRUNC|O_WRONLY) != 1)
+      exit(1);
+    printf("once");
+    if((pid = fork()) < 0)
+      exit(1);
+    if(pid == 0)
+      exit(0);
+    wait(0);
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  fd = open("stdio.out", O_RDONLY);
+  memset(line, 0, sizeof(line));
+  if(read(fd, line, sizeof(line)) != 4 || strcmp(line, "once") != 0){
+    printf("%s: buffered output written %s\n", s, line);
+    exit(1);
+  }
+  close(fd);
+  unlink("stdio.out");
+}
+
+// threads see each other's writes, including to memory that
+// one of them allocated with sbrk().
+static volatile int thcount[8];
+static char * volatile thmem;
+
+static void
+thworker(void *arg)
+{
+  int id = (uint64)arg;
+
+  for(int i = 0; i < 10000; i++)
+    thcount[id]++;
+  if(id == 0){
+    char *p = sbrk(PGSIZE);
+    p[0] = 'T';
+    thmem = p;
+  }
+}
+
+void
+threadtest(char *s)
+{
+  int i, tids[8];
+
+  thmem = 0;
+  for(i = 0; i < 8; i++){
+    thcount[i] = 0;
+    if((tids[i] = kthread_create(thworker, (void*)(uint64)i)) < 0){
+      printf("%s: kthread_create failed\n", s);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1){
+    printf("%s: wait() collected a thread\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 8; i++){
+    if(kthread_join(tids[i]) != tids[i]){
+      printf("%s: join failed\n", s);
+      exit(1);
+    }
+  }
+  if(join(tids[0]) != -1){
+    printf("%s: joined a thread twice\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 8; i++){
+    if(thcount[i] != 10000){
+      printf("%s: thread %d did not run\n", s, i);
+      exit(1);
+    }
+  }
+  if(thmem == 0 || thmem[0] != 'T'){
+    printf("%s: memory from sbrk() in a thread not shared\n", s);
+    exit(1);
+  }
+}
+
+// a store to a page mapped without PROT_WRITE must kill the
+// process, whether or not the page has been faulted in yet.
+void
+mmapro(char *s)
+{
+  char buf[PGSIZE], *p;
+  int fd, pid, touch, xstatus;
+
+  if((fd = open("mro", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create mro failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'r', sizeof(buf));
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write mro failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(touch = 0; touch < 2; touch++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if((fd = open("mro", O_RDONLY)) < 0)
+        exit(1);
+      p = mmap(0, PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+      if(p == (char*)-1)
+        exit(1);
+      if(touch && p[0] != 'r')
+        exit(1);
+      p[0] = 'w';
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != -1){
+      printf("%s: store to read-only mapping not killed (%d)\n", s, touch);
+      exit(1);
+    }
+  }
+  unlink("mro");
+}
+
+// threads share one file descriptor table: a file one thread
+// opens is open in the others, and closing it closes it for all.
+static volatile int tffd;
+
+static void
+tfopen(void *arg)
+{
+  tffd = open("tf", O_CREATE|O_RDWR);
+}
+
+static void
+tfclose(void *arg)
+{
+  close(tffd);
+}
+
+void
+threadfiles(char *s)
+{
+  int tid;
+
+  tffd = -1;
+  if((tid = kthread_create(tfopen, 0)) < 0 || kthread_join(tid) != tid){
+    printf("%s: thread failed\n", s);
+    exit(1);
+  }
+  if(tffd < 0 || write(tffd, "x", 1) != 1){
+    printf("%s: fd %d opened by a thread not usable\n", s, tffd);
+    exit(1);
+  }
+  if((tid = kthread_create(tfclose, 0)) < 0 || kthread_join(tid) != tid){
+    printf("%s: thread failed\n", s);
+    exit(1);
+  }
+  if(write(tffd, "x", 1) != -1){
+    printf("%s: fd closed by a thread still open\n", s);
+    exit(1);
+  }
+  unlink("tf");
+}
+
+// mutexes and condition variables built on futexes.
+static struct mutex fxlock;
+static struct cond fxcond;
+static int fxcount, fxready;
+
+static void
+fxworker(void *arg)
+{
+  for(int i = 0; i < 2000; i++){
+    mutex_lock(&fxlock);
+    int c = fxcount;
+    if(i % 500 == 0)
+      sleep(1);  // make the others wait on the lock
+    fxcount = c + 1;
+    mutex_unlock(&fxlock);
+  }
+  mutex_lock(&fxlock);
+  fxready++;
+  cond_signal(&fxcond);
+  mutex_unlock(&fxlock);
+}
+
+void
+futextest(char *s)
+{
+  int i, tids[4], word = 1;
+
+  if(futex_wait(&word, 2) != -1){
+    printf("%s: futex_wait slept on a changed word\n", s);
+    exit(1);
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf("%s: futex_wake woke someone\n", s);
+    exit(1);
+  }
+
+  mutex_init(&fxlock);
+  cond_init(&fxcond);
+  fxcount = fxready = 0;
+  for(i = 0; i < 4; i++){
+    if((tids[i] = kthread_create(fxworker, 0)) < 0){
+      printf("%s: kthread_create failed\n", s);
+      exit(1);
+    }
+  }
+  mutex_lock(&fxlock);
+  while(fxready < 4)
+    cond_wait(&fxcond, &fxlock);
+  mutex_unlock(&fxlock);
+  for(i = 0; i < 4; i++)
+    kthread_join(tids[i]);
+  if(fxcount != 4*2000){
+    printf("%s: count is %d, not %d\n", s, fxcount, 4*2000);
+    exit(1);
+  }
+}
+
+// the kernel caches name lookups, including failed ones;
+// check that creating and removing names is seen at once.
+void
+dcachetest(char *s)
+{
+  int i, fd;
+
+  for(i = 0; i < 2; i++){
+    if(open("dcd/f", O_RDONLY) >= 0){
+      printf("%s: opened dcd/f before it exists\n", s);
+      exit(1);
+    }
+    if(mkdir("dcd") < 0){
+      printf("%s: mkdir dcd failed\n", s);
+      exit(1);
+    }
+    if(open("dcd/f", O_RDONLY) >= 0){
+      printf("%s: opened dcd/f in a new dcd\n", s);
+      exit(1);
+    }
+    if((fd = open("dcd/f", O_CREATE|O_RDWR)) < 0){
+      printf("%s: create dcd/f failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if((fd = open("dcd/f", O_RDONLY)) < 0){
+      printf("%s: open dcd/f failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    // the second time round, dcd is likely to get the
+    // same inode number again.
+    if(unlink("dcd/f") < 0 || unlink("dcd") < 0){
+      printf("%s: unlink failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// grow a directory far enough that the kernel gives it a hash
+// index, and check lookups while entries come and go.
+void
+hashdir(char *s)
+{
+  enum { N = 400 };
+  int i, pass, fd;
+  char name[16];
+
+  if(mkdir("hd") < 0){
+    printf("%s: mkdir hd failed\n", s);
+    exit(1);
+  }
+  if((fd = open("hd/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create hd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(pass = 0; pass < 3; pass++){
+    for(i = 0; i < N; i++){
+      // pass 0 adds every name, pass 1 removes the odd ones,
+      // pass 2 puts them back.
+      if((pass == 1 || pass == 2) && i % 2 == 0)
+        continue;
+      name[0] = 'h'; name[1] = 'd'; name[2] = '/';
+      name[3] = 'n'; name[4] = '0' + i / 100;
+      name[5] = '0' + (i / 10) % 10; name[6] = '0' + i % 10;
+      name[7] = '\0';
+      if(pass == 1 ? unlink(name) : link("hd/f", name)){
+        printf("%s: pass %d of %s failed\n", s, pass, name);
+        exit(1);
+      }
+    }
+    for(i = 0; i < N; i++){
+      name[4] = '0' + i / 100;
+      name[5] = '0' + (i / 10) % 10; name[6] = '0' + i % 10;
+      fd = open(name, O_RDONLY);
+      if((fd >= 0) != (pass != 1 || i % 2 == 0)){
+        printf("%s: pass %d: open %s gave %d\n", s, pass, name, fd);
+        exit(1);
+      }
+      if(fd >= 0)
+        close(fd);
+    }
+  }
+
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 100;
+    name[5] = '0' + (i / 10) % 10; name[6] = '0' + i % 10;
+    unlink(name);
+  }
+  if(unlink("hd/f") < 0 || unlink("hd") < 0){
+    printf("%s: unlink hd failed\n", s);
+    exit(1);
+  }
+}
+
+// the log statistics should account for creating and writing
+// a file: the inode block logged more than once is absorbed,
+// and the file's data is written in place.
+void
+logstattest(char *s)
+{
+  struct logstat a, b;
+  char buf[BSIZE];
+  int fd;
+
+  if(logstat(&a) < 0){
+    printf("%s: logstat failed\n", s);
+    exit(1);
+  }
+  if((fd = open("ls0", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create ls0 failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'l', sizeof(buf));
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write ls0 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("ls0");
+  if(logstat(&b) < 0){
+    printf("%s: logstat failed\n", s);
+    exit(1);
+  }
+
+  if(b.ops <= a.ops || b.commits <= a.commits || b.logged <= a.logged){
+    printf("%s: ops %l commits %l logged %l did not grow\n", s,
+           b.ops - a.ops, b.commits - a.commits, b.logged - a.logged);
+    exit(1);
+  }
+  if(b.absorbed <= a.absorbed){
+    printf("%s: nothing was absorbed\n", s);
+    exit(1);
+  }
+  if(b.ordered <= a.ordered){
+    printf("%s: file data was not written in place\n", s);
+    exit(1);
+  }
+  if(b.size == 0 || b.maxlogged > b.size){
+    printf("%s: maxlogged %d size %d\n", s, b.maxlogged, b.size);
+    exit(1);
+  }
+}
+
+// keep more than NINODE inodes in use at once, then check
+// that files just closed can still be opened again.
+void
+manyinodes(char *s)
+{
+  enum { NCHILD = 5, NF = 12 };
+  int ready[2], go[2], i, j, fd, pid;
+  char name[8], c;
+
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  name[0] = 'm';
+  name[1] = 'i';
+  name[4] = '\0';
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(go[1]);
+      name[2] = '0' + i;
+      for(j = 0; j < NF; j++){
+        name[3] = 'a' + j;
+        if(open(name, O_CREATE|O_RDWR) < 0){
+          printf("%s: open %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      close(ready[1]);
+      read(go[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(ready[0], &c, 1) != 1){
+      printf("%s: child failed to open its files\n", s);
+      exit(1);
+    }
+  }
+  close(go[1]);
+  close(ready[0]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&j);
+    if(j != 0)
+      exit(1);
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    name[2] = '0' + i;
+    for(j = 0; j < NF; j++){
+      name[3] = 'a' + j;
+      if((fd = open(name, O_RDONLY)) < 0){
+        printf("%s: reopen %s failed\n", s, name);
+        exit(1);
+      }
+      close(fd);
+      unlink(name);
+    }
+  }
+}
+
+// poll() on several pipes, and O_NONBLOCK reads and writes.
+void
+polltest(char *s)
+{
+  int a[2], b[2], i, pid, t0;
+  struct pollfd pfd[3];
+  char c;
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  pfd[2].fd = -1;
+  if(poll(pfd, 3, 0) != 0){
+    printf("%s: empty pipes polled ready\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  if(poll(pfd, 2, 2) != 0 || uptime() - t0 < 2){
+    printf("%s: poll timeout failed\n", s);
+    exit(1);
+  }
+
+  // a child writes to the second pipe while the parent waits.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(1);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLIN){
+    printf("%s: poll missed a write\n", s);
+    exit(1);
+  }
+  wait(0);
+
+  if(fcntl(b[0], F_SETFL, O_NONBLOCK) < 0 ||
+     fcntl(b[0], F_GETFL, 0) != (O_RDONLY|O_NONBLOCK)){
+    printf("%s: fcntl failed\n", s);
+    exit(1);
+  }
+  if(read(b[0], &c, 1) != 1 || c != 'x' || read(b[0], &c, 1) != -1){
+    printf("%s: non-blocking read failed\n", s);
+    exit(1);
+  }
+
+  // fill a non-blocking pipe until it stops taking data.
+  fcntl(a[1], F_SETFL, O_NONBLOCK);
+  for(i = 0; i < 1024; i++){
+    if(write(a[1], buf, 1024) < 0)
+      break;
+  }
+  pfd[0].fd = a[1];
+  pfd[0].events = POLLOUT;
+  if(i == 1024 || poll(pfd, 1, 0) != 0){
+    printf("%s: full pipe still writable\n", s);
+    exit(1);
+  }
+
+  close(b[1]);
+  if(poll(&pfd[1], 1, 0) != 1 || (pfd[1].revents & POLLHUP) == 0){
+    printf("%s: no POLLHUP after close\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+}
+
+// pread/pwrite must not move the shared offset; lseek must.
+void
+prw(char *s)
+{
+  int fd, fd2, i;
+  char c;
+
+  fd = open("prw", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*BSIZE; i++)
+    buf[i] = i % 199;
+  if(write(fd, buf, 2*BSIZE) != 2*BSIZE){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != 2*BSIZE || lseek(fd, -10, SEEK_END) != 2*BSIZE-10){
+    printf("%s: lseek gave wrong offset\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -1, SEEK_SET) >= 0 || lseek(fd, 0, 3) >= 0){
+    printf("%s: bad lseek succeeded\n", s);
+    exit(1);
+  }
+  fd2 = dup(fd);
+  if(lseek(fd, 5, SEEK_SET) != 5){
+    printf("%s: lseek failed\n", s);
+    exit(1);
+  }
+  c = 'x';
+  if(pwrite(fd2, &c, 1, BSIZE+7) != 1){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*BSIZE; i += 97){
+    if(pread(fd2, &c, 1, i) != 1){
+      printf("%s: pread failed\n", s);
+      exit(1);
+    }
+    if((c & 0xff) != i % 199){
+      printf("%s: pread got wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(pread(fd, &c, 1, BSIZE+7) != 1 || c != 'x'){
+    printf("%s: pread missed pwrite data\n", s);
+    exit(1);
+  }
+  if(pread(fd, &c, 1, 2*BSIZE) != 0){
+    printf("%s: pread past EOF returned data\n", s);
+    exit(1);
+  }
+  // the shared offset is still where lseek put it.
+  if(read(fd2, &c, 1) != 1 || c != 5){
+    printf("%s: offset moved\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+  unlink("prw");
+}
+
+// readv/writev on a file and a pipe.
+void
+rwvec(char *s)
+{
+  int fd, fds[2], i, n;
+  char a[10], b[3000];
+  struct iovec iov[3];
+
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  // span more blocks than one writei transaction holds.
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 6*1024;
+  iov[2].iov_base = b;
+  iov[2].iov_len = sizeof(b);
+  for(i = 0; i < 6*1024; i++)
+    buf[i] = i % 251;
+
+  fd = open("rwvec", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  n = sizeof(a) + 6*1024 + sizeof(b);
+  if(writev(fd, iov, 3) != n){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  memset(buf, 0, 6*1024);
+  fd = open("rwvec", O_RDONLY);
+  // leave the last byte for read() to pick up.
+  iov[2].iov_len = sizeof(b) - 1;
+  if(readv(fd, iov, 3) != n - 1 || read(fd, b, 1) != 1){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, 3) != 0){
+    printf("%s: readv at EOF failed\n", s);
+    exit(1);
+  }
+  // lengths that add up to more than an int are refused.
+  iov[0].iov_len = iov[1].iov_len = 0x40000000;
+  if(writev(fd, iov, 2) != -1){
+    printf("%s: writev of 2 GB accepted\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwvec");
+  for(i = 0; i < sizeof(a); i++){
+    if(a[i] != 'a'){
+      printf("%s: wrong data in first buffer\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < 6*1024; i++){
+    if((buf[i] & 0xff) != i % 251){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  for(i = 0; i < sizeof(b); i++){
+    if(b[i] != 'b'){
+      printf("%s: wrong data in last buffer\n", s);
+      exit(1);
+    }
+  }
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "hello ";
+  iov[0].iov_len = 6;
+  iov[1].iov_base = "world";
+  iov[1].iov_len = 5;
+  if(writev(fds[1], iov, 2) != 11){
+    printf("%s: pipe writev failed\n", s);
+    exit(1);
+  }
+  memset(b, 0, sizeof(b));
+  iov[0].iov_base = b;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = b + 3;
+  iov[1].iov_len = 100;
+  if(readv(fds[0], iov, 2) != 11 || strcmp(b, "hello world") != 0){
+    printf("%s: pipe readv failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
 
 // test if child is killed (status = -1)
 void
@@ -2871,6 +3775,21 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipebig, "pipebig"},
+    {splicetest, "splice"},
+    {copyrange, "copyrange"},
+    {rwvec, "rwvec"},
+    {prw, "prw"},
+    {stdiotest, "stdio"},
+    {polltest, "poll"},
+    {threadtest, "threads"},
+    {threadfiles, "threadfiles"},
+    {futextest, "futex"},
+    {mmapro, "mmapro"},
+    {manyinodes, "manyinodes"},
+    {dcachetest, "dcache"},
+    {hashdir, "hashdir"},
+    {logstattest, "logstat"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
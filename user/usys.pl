@@ -6,24 +6,28 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry(name[, symbol]) emits the stub for SYS_name as symbol,
+# which defaults to name.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $sym = shift || $name;
+    print ".global $sym\n";
+    print "${sym}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+# ulib.c wraps these to flush stdio buffers first.
+entry("fork", "_fork");
+entry("exit", "_exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("exec", "_exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -38,3 +42,17 @@ entry("sleep");
 entry("uptime");
 entry("mmap");
 entry("munmap");
+entry("splice");
+entry("copy_file_range");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("lseek");
+entry("fcntl");
+entry("poll");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("logstat");